@@ -1,54 +1,46 @@
 #pragma once
 #include <algorithm>
-#include <unordered_map>
 #include <string>
 #include "board.h"
 
+/**
+ * plain action value, dispatched by its type tag
+ *
+ * code (32-bit form):
+ *  type_flag('s') | opcode         for sliding
+ *  type_flag('p') | tile << 4 | pos for placing
+ *  -1u                             for no action
+ *
+ * an action can also be packed into 16 bits for compact records:
+ *  bit 15-14: 1 for sliding, 2 for placing, 0 for no action
+ *  bit 13-0 : event
+ */
 class action {
-friend class agent;
-friend class rndenv;
 public:
 	action(unsigned code = -1u) : code(code) {}
-	action(const action& a) : code(a.code) {}
-	virtual ~action() {}
+	action(const action& a) = default;
+	action& operator =(const action& a) = default;
 
 	class slide; // create a sliding action with board opcode
 	class place; // create a placing action with position and tile
 
+	typedef uint16_t packed;
+
 public:
-	virtual board::reward apply(board& b) const {
-		auto proto = entries().find(type());
-		if (proto != entries().end()) return proto->second->reinterpret(this).apply(b);
-		return -1;
-	}
-	virtual std::ostream& operator >>(std::ostream& out) const {
-		auto proto = entries().find(type());
-		if (proto != entries().end()) return proto->second->reinterpret(this) >> out;
-		return out << "??";
-	}
-	virtual std::istream& operator <<(std::istream& in) {
-		auto state = in.rdstate();
-		for (auto proto = entries().begin(); proto != entries().end(); proto++) {
-			if (proto->second->reinterpret(this) << in) return in;
-			in.clear(state);
-		}
-		return in.ignore(2);
-	}
+	board::reward apply(board& b) const;
+	packed pack() const;
+	static action unpack(packed v);
 
 public:
 	operator unsigned() const { return code; }
 	unsigned type() const { return code & type_flag(-1u); }
 	unsigned event() const { return code & ~type(); }
-	friend std::ostream& operator <<(std::ostream& out, const action& a) { return a >> out; }
-	friend std::istream& operator >>(std::istream& in, action& a) { return a << in; }
+	friend std::ostream& operator <<(std::ostream& out, const action& a);
+	friend std::istream& operator >>(std::istream& in, action& a);
 
 protected:
 	static constexpr unsigned type_flag(unsigned v) { return v << 24; }
 
-	typedef std::unordered_map<unsigned, action*> prototype;
-	static prototype& entries() { static prototype m; return m; }
-	virtual action& reinterpret(const action* a) const { return *new (const_cast<action*>(a)) action(*a); }
-
 	unsigned code;
 };
 
@@ -57,30 +49,6 @@ public:
 	static constexpr unsigned type = type_flag('s');
 	slide(unsigned oper) : action(slide::type | (oper & 0b11)) {}
 	slide(const action& a = {}) : action(a) {}
-public:
-	board::reward apply(board& b) const {
-		return b.slide(event());
-	}
-	std::ostream& operator >>(std::ostream& out) const {
-		return out << '#' << ("URDL")[event() & 0b11];
-	}
-	std::istream& operator <<(std::istream& in) {
-		if (in.peek() == '#') {
-			char v;
-			in.ignore(1) >> v;
-			const char* opc = "URDL";
-			unsigned oper = std::find(opc, opc + 4, v) - opc;
-			if (oper < 4) {
-				operator= (action::slide(oper));
-				return in;
-			}
-		}
-		in.setstate(std::ios::failbit);
-		return in;
-	}
-protected:
-	action& reinterpret(const action* a) const { return *new (const_cast<action*>(a)) slide(*a); }
-	static __attribute__((constructor)) void init() { entries()[type_flag('s')] = new slide; }
 };
 
 class action::place : public action {
@@ -90,30 +58,57 @@ public:
 	place(const action& a = {}) : action(a) {}
 	unsigned position() const { return event() & 0x0f; }
 	unsigned tile() const { return event() >> 4; }
-public:
-	board::reward apply(board& b) const {
-		return b.place(position(), tile());
+};
+
+inline board::reward action::apply(board& b) const {
+	switch (type()) {
+	case slide::type: return b.slide(event());
+	case place::type: return b.place(place(*this).position(), place(*this).tile());
+	default: return -1;
+	}
+}
+
+inline action::packed action::pack() const {
+	switch (type()) {
+	case slide::type: return packed(0x4000 | (event() & 0x3fff));
+	case place::type: return packed(0x8000 | (event() & 0x3fff));
+	default: return 0;
+	}
+}
+
+inline action action::unpack(packed v) {
+	switch (v >> 14) {
+	case 1: return action(slide::type | (v & 0x3fff));
+	case 2: return action(place::type | (v & 0x3fff));
+	default: return action();
 	}
-	std::ostream& operator >>(std::ostream& out) const {
-		const char* idx = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ?";
-		return out << idx[position()] << idx[std::min(tile(), 36u)];
+}
+
+inline std::ostream& operator <<(std::ostream& out, const action& a) {
+	const char* idx = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ?";
+	switch (a.type()) {
+	case action::slide::type: return out << '#' << ("URDL")[a.event() & 0b11];
+	case action::place::type: return out << idx[action::place(a).position()] << idx[std::min(action::place(a).tile(), 36u)];
+	default: return out << "??";
 	}
-	std::istream& operator <<(std::istream& in) {
-		const char* idx = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-		char v = in.peek();
-		unsigned pos = std::find(idx, idx + 16, v) - idx;
-		if (pos < 16) {
-			in.ignore(1) >> v;
-			unsigned tile = std::find(idx, idx + 36, v) - idx;
-			if (tile < 36) {
-				operator =(action::place(pos, tile));
-				return in;
-			}
-		}
-		in.setstate(std::ios::failbit);
+}
+
+inline std::istream& operator >>(std::istream& in, action& a) {
+	const char* idx = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	const char* opc = "URDL";
+	char v = in.peek();
+	if (v == '#') {
+		in.ignore(1) >> v;
+		unsigned oper = std::find(opc, opc + 4, v) - opc;
+		if (oper < 4) a = action::slide(oper);
 		return in;
 	}
-protected:
-	action& reinterpret(const action* a) const { return *new (const_cast<action*>(a)) place(*a); }
-	static __attribute__((constructor)) void init() { entries()[type_flag('p')] = new place; }
-};
+	unsigned pos = std::find(idx, idx + 16, v) - idx;
+	if (pos < 16) {
+		in.ignore(1) >> v;
+		unsigned tile = std::find(idx, idx + 36, v) - idx;
+		if (tile < 36) a = action::place(pos, tile);
+		return in;
+	}
+	return in.ignore(2);
+}
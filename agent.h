@@ -10,6 +10,9 @@
 #include "episode.h"
 #include "state.h"
 #include "weight.h"
+#include "profiler.h"
+#include "rng.h"
+#include "cache.h"
 
 //std::ostream& info = std::cout;
 //std::ostream& error = std::cerr;
@@ -52,90 +55,108 @@ protected:
 	std::map<key, value> meta;
 };
 
+/**
+ * base agent for randomness
+ *
+ * every game draws from its own streams, derived from (seed, game index, stream id),
+ * so a single game can be replayed by "seed=... game=..." regardless of what ran before it
+ */
 class random_agent : public agent {
 public:
-	random_agent(const std::string& args = "") : agent(args) {
+	random_agent(const std::string& args = "") : agent(args), seed(0), game(0) {
 		if (meta.find("seed") != meta.end())
-			engine.seed(int(meta["seed"]));
+			seed = std::stoull(meta["seed"]);
+		if (meta.find("game") != meta.end())
+			game = std::stoull(meta["game"]);
+		open_stream(game); // only the streams of random_agent, a derived agent with more streams opens them again
 	}
 	virtual ~random_agent() {}
 
+	virtual void open_episode(const std::string& flag = "") {
+		open_stream(game++);
+	}
+
+	/**
+	 * set the index of the next game to be opened
+	 */
+	void set_game(uint64_t index) {
+		game = index;
+	}
+	uint64_t next_game() const {
+		return game;
+	}
+	uint64_t base_seed() const {
+		return seed;
+	}
+
+	/**
+	 * select the random streams of the given game index
+	 */
+	virtual void open_stream(uint64_t index) {
+		engine.seed(seed, index, role() == "environment" ? stream_environment : stream_player);
+	}
+
 protected:
-	std::default_random_engine engine;
+	enum stream : uint32_t { stream_environment = 0, stream_bonus = 1, stream_player = 2 };
+
+	xoshiro engine;
+	uint64_t seed;
+	uint64_t game;
 };
 
+/**
+ * the bag of 12 normal tiles (four 1s, four 2s and four 3s), as a 12-bit mask
+ * index 0-3 are 1s, 4-7 are 2s, 8-11 are 3s, a set bit means the tile has been taken
+ */
 class tile_bag{
 public:
 	tile_bag(){
 		reset();
 	}
+	/**
+	 * take the k-th remaining tile (0 <= k < remain()) out of the bag and return its index
+	 * the bag is refilled once all 12 tiles have been taken
+	 */
+	int take(int k) {
+		unsigned free = ~bag & 0xfff;
+		while (k--) free &= free - 1; // drop the lowest k free slots
+		int index = __builtin_ctz(free);
+		set(index);
+		return index;
+	}
 	void set(int index) {
-		//for(int i=0;i<12;++i){
-			//std::cout << bag[i] << " ";
-		//}
-		bag[index] = true;
-		++count;
-		//std::cout << " set (" << index << ") ";
-		if(count==12)
-			reset();
-		/*int i;
-		for(i=0;i<12;++i)
-			if(bag[i]==false) break;
-		if(i==12){
+		bag |= 1u << index;
+		if(bag==0xfff)
 			reset();
-			//std::cout << "reset";
-		}*/
-		//std::cout << std::endl;
-		return;
 	}
-	bool get(int num) {
-		if(bag[num])
-			return true;
-		else
-			return false;
-	}
-	/*int get(int num) {
-		num = num * 4;
-		int i;
-		for(i=0;i<4;++i)
-			if(!bag[num+i]) break;//return num+i;
-
-		if(i==4) // this tile cannot be picked
-			return -1;
-		else
-			return num+i;
-	}*/
-	int get_count(){
-		return count;
+	bool get(int num) const {
+		return (bag >> num) & 1;
+	}
+	int get_count() const {
+		return __builtin_popcount(bag);
+	}
+	int remain() const {
+		return 12 - get_count();
 	}
 	void reset(){
-		//bag = {false,false,false};
-		for(int i=0;i<12;++i)
-			bag[i] = false;
-		count = 0;
-		//std::cout<< "reset bag ";
+		bag = 0;
 	}
 private:
-	std::array<bool, 12> bag;
-	int count;
+	unsigned bag;
 };
 
 class bonus_bag
 {
 public:
-	bonus_bag():bonus_popup(1, 21){}
+	bonus_bag() { reset(); }
 
 	void init(){
 		//bonus.push_back(4); //put the first bonus tile "6"
 	}
 
 	int popup_bonus(){
-		//std::cout << " popup_bonus ";
-		int flag = bonus_popup(b_engine);
-		if(flag==21){
-			if(bonus.size()>1) std::shuffle(bonus.begin(), bonus.end(), b_engine);
-			return bonus.front();
-		}
+		if(b_engine.uniform(21)==20) // 1/21 chance
+			return bonus[b_engine.uniform(bonus.size())];
 		else 
 			return 0;
 	}
@@ -150,61 +171,47 @@ public:
 		bonus.erase(bonus.begin(), bonus.begin()+bonus.size()-1);
 	}
 
-	/*int get_max_tile(){
-		return max_tile;
-	}*/
+	void seed(uint64_t seed, uint64_t game, uint32_t stream){
+		b_engine.seed(seed, game, stream);
+	}
+
 private:
-	std::default_random_engine b_engine;
-	std::uniform_int_distribution<int> bonus_popup;
+	xoshiro b_engine;
 	std::vector<int> bonus;
-	//int max_tile;
 };
 
 class rndenv : public random_agent {
 public:
 	rndenv(const std::string& args = "") : random_agent("name=random role=environment " + args),
-		space({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }), popup(0, 11),/*popup(1, 12),*//* bonus_popup(1, 21),*/
-		env_tile_bag(), bonus_tile_bag(), max_tile(0) {}
+		env_tile_bag(), bonus_tile_bag(), max_tile(0) {
+		open_stream(game); // the constructor of random_agent cannot reach the override, which also seeds the bonus stream
+	}
 		//slide_up({12, 13, 14, 15}), slide_down({0,1,2,3}), slide_left({3,7,11,15}), slide_right({0,4,8,12}), popup(1, 3) {}
 
 	//virtual action take_action(const board& after) {
 	virtual action take_action(const episode& game) {
+		PROFILE_SCOPE(place);
 		const board& after = game.state();
 		if(game.ep_moves.size()<9) { //initial 9 tiles + 1 hint tile
-			std::shuffle(space.begin(), space.end(), engine);
-			board::cell tile;
-			
-			/*while(true){
-				tile = popup(engine);
-				if (env_tile_bag.get(tile-1)) continue; //see whether the tile has been used
-				else break; // grad a new tile
-			}*/
-			tile = generate_normal_tile();
-			//std::cout << tile << " ";
-
-			for (int pos : space) {
-				if (after(pos) != 0) continue;
-				else{
-					if (game.ep_moves.size()==8){
-						hint = generate_normal_tile();
-						//std::cout << hint << " ";
-						//std::cout << "first hint: " << hint << std::endl;
-					} 
-						
-					return action::place(pos, tile);
-				}				
-				//env_tile_bag.set(tile-1); //take the tile out of the bag
-				//return action::place(pos, tile);
+			std::array<int, 16> space;
+			int empty = 0;
+			for (int pos = 0; pos < 16; pos++)
+				if (after(pos) == 0) space[empty++] = pos;
+			if (empty == 0) return action();
+
+			board::cell tile = generate_normal_tile();
+			int pos = space[engine.uniform(empty)];
+			if (game.ep_moves.size()==8){
+				hint = generate_normal_tile();
+				//std::cout << "first hint: " << hint << std::endl;
 			}
-
-			
-			return action();
+			return action::place(pos, tile);
 		} else {
 			//According to the player's last action, determine where can put tile
 			std::array<int,4> slide_space;
 			
 			//if(game.ep_moves.back().reward )
-			switch (game.ep_moves.back().code.code & 0b11) {
+			switch (action(game.ep_moves.back()).event() & 0b11) {
 				case 0: slide_space = {12, 13, 14, 15}; //slide up 0
 					break;
 				case 1: slide_space = {0, 4, 8, 12}; //slide right 1
@@ -214,10 +221,8 @@ public:
 				case 3: slide_space = {3, 7, 11, 15}; //slide left 3
 					break;
 				default:
-					std::cout << "no such action! " << (game.ep_moves.back().code.code & 0b11)<< "\n";
+					std::cout << "no such action! " << (action(game.ep_moves.back()).event() & 0b11)<< "\n";
 			}
-						
-			std::shuffle(slide_space.begin(), slide_space.end(), engine);
 
 			//Generate the hint tile
 			check_max_tile(game.state());
@@ -237,21 +242,23 @@ public:
 				env_tile_bag.set(tile-1); //take the tile out of the bag
 			}*/			
 			////////////////////////
-			for (int slide_pos : slide_space) {
-				if (after(slide_pos) != 0) continue;
-				else{
-					int cur = hint;
-					hint = tile;
-					//std::cout << game.ep_moves.size() << " curren tile: " << cur << " hint tile: " << hint << std::endl;
-					//if(env_tile_bag.get_count()==12) env_tile_bag.reset();
-					return action::place(slide_pos, cur);
-				}
-				
-			}
-			return action();	
+			int empty = 0;
+			for (int slide_pos : slide_space)
+				if (after(slide_pos) == 0) slide_space[empty++] = slide_pos;
+			if (empty == 0) return action();
+
+			int cur = hint;
+			hint = tile;
+			//std::cout << game.ep_moves.size() << " curren tile: " << cur << " hint tile: " << hint << std::endl;
+			return action::place(slide_space[engine.uniform(empty)], cur);
 		}
 	}
 	
+	virtual void open_stream(uint64_t index) {
+		random_agent::open_stream(index);
+		bonus_tile_bag.seed(seed, index, stream_bonus);
+	}
+
 	virtual void close_episode(const std::string& flag = "") {
 		env_tile_bag.reset();
 		bonus_tile_bag.reset();
@@ -261,15 +268,7 @@ public:
 	}
 
 	int generate_normal_tile(){
-		int /*tile,*/ index;
-		while(true){
-			index = popup(engine); //-1;
-			if (env_tile_bag.get(index)) continue;
-			//index = env_tile_bag.get(tile-1);
-			//if (index==-1) continue; //see whether the tile has been used
-			else break; // grad a new tile
-		}
-		env_tile_bag.set(index); //take the tile out of the bag
+		int index = env_tile_bag.take(engine.uniform(env_tile_bag.remain())); //take the tile out of the bag
 		return index/4 + 1;
 	}
 
@@ -288,10 +287,6 @@ public:
 	}
 
 private:
-	std::array<int, 16> space;
-	//std::array<int, 4> slide_up, slide_down, slide_left, slide_right;
-	std::uniform_int_distribution<int> popup;
-	//std::uniform_int_distribution<int> bonus_popup;
 	tile_bag env_tile_bag;
 	bonus_bag bonus_tile_bag;
 	//bool bonus_trigger;
@@ -310,11 +305,12 @@ public:
 
 	//virtual action take_action(const board& before) {
 	virtual action take_action(const episode& game) {
+		PROFILE_SCOPE(generate);
 		const board& before = game.state();
+		unsigned legal = before.legal_moves();
 		std::shuffle(opcode.begin(), opcode.end(), engine);
 		for (int op : opcode) {
-			board::reward reward = board(before).slide(op);
-			if (reward != -1) return action::slide(op);
+			if (legal & (1u << op)) return action::slide(op);
 		}
 		return action();
 	}
@@ -327,6 +323,13 @@ private:
 class TD_player : public agent {
 public:
 	TD_player(const std::string& args = "") : agent(args), alpha(0.0125) {
+		if (meta.find("page") != meta.end()) { // pass page=thp|2m|1g to back the weight tables by huge pages
+			std::string page = meta["page"];
+			table_policy::current().page = page == "1g" ? table_policy::huge_1g : page == "2m" ? table_policy::huge_2m :
+			                               page == "thp" ? table_policy::thp : table_policy::normal;
+		}
+		if (meta.find("numa") != meta.end()) // pass numa=interleave to interleave the weight tables over all nodes
+			table_policy::current().interleave = (std::string(meta["numa"]) == "interleave");
 		//if (meta.find("init") != meta.end()) // pass init=... to initialize the weight
 		//	init_weights(meta["init"]);
 		init_weights();
@@ -334,18 +337,27 @@ public:
 			load_weights(meta["load"]);
 		if (meta.find("alpha") != meta.end())
 			alpha = float(meta["alpha"]);
+		if (meta.find("cache") != meta.end()) // pass cache=20 to memoize evaluation() in 2^20 entries
+			memo = transposition<board, float>(int(meta["cache"]));
 	}
 	virtual ~TD_player() {
+		report_occupancy();
 		if (meta.find("save") != meta.end()) // pass save=... to save to a specific file
 			save_weights(meta["save"]);
 	}
 
 public:
-	void add_feature(iso_pattern* patt) {
-		net.push_back(*patt);
+	/**
+	 * construct a pattern feature in place, see iso_pattern for the arguments
+	 * reserve net first, so that adding a feature never copies the tables of the others
+	 */
+	void add_feature(const std::vector<int>& p, int iso = 8, weight::storage kind = weight::dense) {
+		net.emplace_back(p, iso, kind);
+		const iso_pattern& patt = net.back();
 
-		info << patt->name() << ", size = " << patt->size();
-		size_t usage = patt->size() * sizeof(float);
+		info << patt.name() << ", size = " << patt.size();
+		size_t usage = patt.size() * sizeof(float);
+		if (patt.type() == weight::sparse) info << ", sparse up to";
 		if (usage >= (1 << 30)) {
 			info << " (" << (usage >> 30) << "GB)";
 		} else if (usage >= (1 << 20)) {
@@ -353,6 +365,8 @@ public:
 		} else if (usage >= (1 << 10)) {
 			info << " (" << (usage >> 10) << "KB)";
 		}
+		if ((meta.find("page") != meta.end() || meta.find("numa") != meta.end()) && patt.type() == weight::dense)
+			info << " [" << table_policy::report(patt.block_data(0)) << "]";
 		info << std::endl;
 	}
 
@@ -368,6 +382,52 @@ public:
 		return value;
 	}
 
+	/**
+	 * accumulate the total value of a state by its feature indices, see lookahead
+	 */
+	float evaluation(const size_t* index) const {
+		float value = 0;
+		for (auto& wght : net) {
+			value += wght.eval(index);
+			index += 8;
+		}
+		return value;
+	}
+
+	/**
+	 * generate the legal after states of a before state b and prefetch their weights,
+	 * so that the evaluation in a later take_action(b) of the selected lane overlaps its cache misses with other work
+	 * the after states and their indices are kept in the lookahead of the lane, and reused by take_action(b)
+	 */
+	void prefetch(const board& b) {
+		if (ahead.size() <= lane) ahead.resize(lane + 1);
+		lookahead& next = ahead[lane];
+		next.before = b;
+		next.legal = b.legal_moves();
+		next.index.resize(4 * net.size() * 8);
+		for (int op = 0; op < 4; op++) {
+			if (!(next.legal & (1u << op))) continue;
+			next.after[op].assign(b);
+			size_t* index = &next.index[op * net.size() * 8];
+			for (auto& wght : net) {
+				wght.indices(next.after[op].after_state(), index);
+				wght.prefetch(index);
+				index += 8;
+			}
+		}
+		next.ready = true;
+	}
+
+	/**
+	 * evaluation() memoized by the transposition cache, if enabled
+	 * the cache is invalidated whenever the weights are changed
+	 */
+	float estimate(const board& b) {
+		float value;
+		if (!memo.find(b, value)) memo.store(b, value = evaluation(b));
+		return value;
+	}
+
 	/**
 	 * update the value of given state and return its new value
 	 */
@@ -397,11 +457,30 @@ public:
 	//action select_best_move(const episode& game) {
 	virtual action take_action(const episode& game){
 		const board& b = game.state();
+		unsigned legal = b.legal_moves();
+		if (legal == 0) return action(); // terminal state, nothing to record
+
+		lookahead* prev = lane < ahead.size() && ahead[lane].ready && ahead[lane].before == b ? &ahead[lane] : nullptr;
+		if (prev) prev->ready = false;
+
 		state after[4] = { 0, 1, 2, 3 }; // up, right, down, left
 		state* best = after;
 		for (state* move = after; move != after + 4; move++) {
-			if (move->assign(b)) {
-				move->set_value(move->reward() + evaluation(move->after_state()));
+			if (legal & (1u << move->action())) {
+				if (prev) { // generated and prefetched by prefetch(b)
+					*move = prev->after[move->action()];
+					PROFILE_SCOPE(evaluate);
+					move->set_value(move->reward() + evaluation(&prev->index[move->action() * net.size() * 8]));
+					if (move->value() > best->value())
+						best = move;
+					continue;
+				}
+				{
+					PROFILE_SCOPE(generate);
+					move->assign(b);
+				}
+				PROFILE_SCOPE(evaluate);
+				move->set_value(move->reward() + estimate(move->after_state()));
 				if (move->value() > best->value())
 					best = move;
 			} else {
@@ -411,34 +490,47 @@ public:
 		}
 		//debug << "best move: " << *best;
 		path.push_back(*best);
-		if(best->reward()==-1) return action();
-		else return action::slide(best->action());
+		return action::slide(best->action());
 	}
 
 	/**
 	 * update the tuple network by an episode
 	 *
-	 * path is the sequence of states in pisode,
-	 * the last entry in path (path.back()) is the final state
+	 * path is the sequence of states in episode, in the compact form of trajectory,
+	 * the terminal state is not recorded since it has no legal move
 	 *
 	 * for example, a 2048 games consists of
 	 *  (initial) s0 --(a0,r0)--> s0' --(popup)--> s1 --(a1,r1)--> s1' --(popup)--> s2 (terminal)
 	 *  where sx is before state, sx' is after state
 	 *
 	 * its path would be
-	 *  { (s0,s0',a0,r0), (s1,s1',a1,r1), (s2,s2,x,-1) }
+	 *  { (s0,s0',a0,r0), (s1,s1',a1,r1) }
 	 *  where (x,x,x,x) means (before state, after state, action, reward)
 	 */
 	//void update_episode(std::vector<state>& path, float alpha = 0.1) const {
 	void update_episode() {
+		PROFILE_SCOPE(update);
 		//std::cout << "update_episode()\n";
 		float exact = 0;
-		for (path.pop_back() /* terminal state */; path.size(); path.pop_back()) {
-			state& move = path.back();
+		for (; path.size(); path.pop_back()) {
+			trajectory::step& move = path.back();
 			float error = exact - (move.value() - move.reward());
 			//debug << "update error = " << error << " for after state" << std::endl << move.after_state();
 			exact = move.reward() + update(move.after_state(), alpha * error);
 		}
+		if (alpha != 0) memo.clear();
+	}
+
+	/**
+	 * select the lane to record the path into, for playing several games at once
+	 * lane 0 is used by default, update_episode() only consumes the selected lane
+	 */
+	void select_lane(size_t i) {
+		if (lanes.size() <= i) lanes.resize(i + 1);
+		// the path of the selected lane always lives in 'path', its slot in 'lanes' is unused
+		lanes[lane].swap(path);
+		path.swap(lanes[i]);
+		lane = i;
 	}
 
 	/**
@@ -517,37 +609,95 @@ public:
 		// initialize the features
 		//debug << "init_weights\n" ;
 
-		add_feature(new iso_pattern({ 0, 1, 2, 3, 4, 5 }));
-		add_feature(new iso_pattern({ 4, 5, 6, 7, 8, 9 }));
-		add_feature(new iso_pattern({ 0, 1, 2, 4, 5, 6 }));
-		add_feature(new iso_pattern({ 4, 5, 6, 8, 9, 10 }));
+		if (meta.find("tuples") != meta.end()) { // pass tuples=01234567,456789ab:dense,... to choose the patterns
+			std::stringstream ss(meta["tuples"]);
+			std::vector<std::string> specs;
+			for (std::string spec; std::getline(ss, spec, ','); ) specs.push_back(spec);
+			net.reserve(specs.size());
+			for (const std::string& spec : specs) {
+				std::string cells = spec.substr(0, spec.find(':'));
+				std::vector<int> p;
+				for (char c : cells) p.push_back(std::stoi(std::string(1, c), nullptr, 16));
+				// tuples larger than 6 are sparse by default, since their dense tables exceed 680MB
+				weight::storage kind = p.size() > 6 ? weight::sparse : weight::dense;
+				if (spec.find(":sparse") != std::string::npos) kind = weight::sparse;
+				if (spec.find(":dense") != std::string::npos) kind = weight::dense;
+				add_feature(p, 8, kind);
+			}
+		} else {
+			net.reserve(4);
+			add_feature({ 0, 1, 2, 3, 4, 5 });
+			add_feature({ 4, 5, 6, 7, 8, 9 });
+			add_feature({ 0, 1, 2, 4, 5, 6 });
+			add_feature({ 4, 5, 6, 8, 9, 10 });
+		}
 		path.reserve(20000);
 	}
+
+	/**
+	 * display the occupancy of the sparse tables, e.g.
+	 *  8-tuple pattern 01234567, sparse 35112 of 2562890 blocks (1.37%), 137MB
+	 */
+	void report_occupancy(std::ostream& out = info) const {
+		for (const iso_pattern& p : net) {
+			if (p.type() != weight::sparse) continue;
+			size_t used = p.allocated();
+			out << p.name() << ", sparse " << used << " of " << p.blocks() << " blocks";
+			out << " (" << (100.0 * used / p.blocks()) << "%), " << ((used * weight::block * sizeof(float)) >> 20) << "MB" << std::endl;
+		}
+	}
 	virtual void load_weights(const std::string& path) {
 		std::ifstream in(path, std::ios::in | std::ios::binary);
 		if (!in.is_open()) std::exit(-1);
+		std::string sig(weight::signature().size(), '\0');
+		in.read(&sig[0], sig.size());
+		if (sig != weight::signature()) {
+			error << path << " is not a weight file of base-15 indexing, the files saved before it cannot be loaded" << std::endl;
+			std::exit(-1);
+		}
 		uint32_t size;
 		in.read(reinterpret_cast<char*>(&size), sizeof(size));
 		net.resize(size);
 		for (iso_pattern& p : net) in >> p;
 		in.close();
+		memo.clear();
 		std::cout << "load weights success\n";
 	}
 	virtual void save_weights(const std::string& path) {
 		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
 		if (!out.is_open()) std::exit(-1);
+		out.write(weight::signature().data(), weight::signature().size());
 		uint32_t size = net.size();
 		out.write(reinterpret_cast<char*>(&size), sizeof(size));
 		for (iso_pattern& p : net) out << p;
 		out.close();
 		std::cout << "save weights success\n";
 	}
+	std::vector<iso_pattern>& network() {
+		return net;
+	}
 
 
 protected:
 	std::vector<iso_pattern> net;
-	std::vector<state> path;
+	trajectory path;
+	std::vector<trajectory> lanes;
+	size_t lane = 0;
+
+	/**
+	 * the after states of a before state and their feature indices (8 per feature, by action),
+	 * generated by prefetch() and reused by the next take_action() of the same lane
+	 */
+	struct lookahead {
+		board before;
+		unsigned legal = 0;
+		state after[4] = { 0, 1, 2, 3 };
+		std::vector<size_t> index;
+		bool ready = false;
+	};
+	std::vector<lookahead> ahead; // by lane
 	std::vector<int> scores;
 	std::vector<int> maxtile;
 	float alpha;
+	transposition<board, float> memo;
 };
\ No newline at end of file
@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "board.h"
+
+/**
+ * structure-of-arrays batch of boards for vectorized sliding
+ *
+ * cell i of board k is stored as cell[i][k], one byte per cell,
+ * so that the same cell of all boards fits in one SIMD register, and a slide of the whole batch
+ * takes a few dozen vector operations
+ * the batch holds 32 boards if compiled with AVX2 (e.g. -mavx2 or -march=native), or 16 otherwise
+ *
+ * usage:
+ *  board_batch batch;
+ *  for (unsigned k = 0; k < board_batch::width; k++) batch.set(k, boards[k]);
+ *  board::reward reward[board_batch::width];
+ *  uint32_t legal = batch.slide(opcode, reward); // bit k is set if board k has moved
+ */
+class board_batch {
+public:
+#ifdef __AVX2__
+	static constexpr unsigned width = 32;
+#else
+	static constexpr unsigned width = 16;
+#endif
+	typedef uint8_t lane __attribute__((vector_size(width)));
+
+public:
+	board_batch() : cell() {}
+
+	void set(unsigned k, const board& b) {
+		for (int i = 0; i < 16; i++) cell[i][k] = b(i);
+	}
+	board get(unsigned k) const {
+		board b;
+		for (int i = 0; i < 16; i++) b(i) = cell[i][k];
+		return b;
+	}
+
+public:
+	/**
+	 * apply an action to all boards
+	 * store the reward of each board, or -1 if the action is illegal for that board
+	 * return the bitmask of boards for which the action is legal
+	 */
+	uint32_t slide(unsigned opcode, board::reward reward[width]) {
+		switch (opcode & 0b11) {
+		case 0: return slide_up(reward);
+		case 1: return slide_right(reward);
+		case 2: return slide_down(reward);
+		case 3: return slide_left(reward);
+		default: return 0;
+		}
+	}
+
+	uint32_t slide_left(board::reward reward[width]) {
+		static const int line[4][4] = { { 0, 1, 2, 3 }, { 4, 5, 6, 7 }, { 8, 9, 10, 11 }, { 12, 13, 14, 15 } };
+		return slide_lines(line, reward);
+	}
+	uint32_t slide_right(board::reward reward[width]) {
+		static const int line[4][4] = { { 3, 2, 1, 0 }, { 7, 6, 5, 4 }, { 11, 10, 9, 8 }, { 15, 14, 13, 12 } };
+		return slide_lines(line, reward);
+	}
+	uint32_t slide_up(board::reward reward[width]) {
+		static const int line[4][4] = { { 0, 4, 8, 12 }, { 1, 5, 9, 13 }, { 2, 6, 10, 14 }, { 3, 7, 11, 15 } };
+		return slide_lines(line, reward);
+	}
+	uint32_t slide_down(board::reward reward[width]) {
+		static const int line[4][4] = { { 12, 8, 4, 0 }, { 13, 9, 5, 1 }, { 14, 10, 6, 2 }, { 15, 11, 7, 3 } };
+		return slide_lines(line, reward);
+	}
+
+private:
+	/**
+	 * slide every line toward its first cell, following the rules of board::slide_left
+	 *
+	 * a line moves at its first position p where
+	 *  a[p] is empty, or a[p] + a[p+1] == 3, or a[p] >= 3 and a[p] == a[p+1]
+	 * then a[p] becomes the merged tile (or a[p+1] if a[p] is empty),
+	 * the cells after p shift by one, and the last cell becomes empty
+	 * the reward of a merge is 1 << (merged tile), exactly as board::slide_left counts it
+	 */
+	uint32_t slide_lines(const int (&line)[4][4], board::reward reward[width]) {
+		const lane zero = {}, one = zero + 1, three = zero + 3;
+		lane moved = {};
+		for (unsigned k = 0; k < width; k++) reward[k] = 0;
+
+		for (int i = 0; i < 4; i++) {
+			lane a[5] = { cell[line[i][0]], cell[line[i][1]], cell[line[i][2]], cell[line[i][3]], zero };
+			lane g[3], merged[3];
+			for (int p = 0; p < 3; p++) {
+				lane sum3 = lane(a[p] + a[p + 1] == three);
+				lane same = lane(a[p] >= three) & lane(a[p] == a[p + 1]);
+				g[p] = lane(a[p] == zero) | sum3 | same;
+				merged[p] = (a[p] == zero) ? a[p + 1] : (sum3 ? three : a[p] + one);
+			}
+			lane before = ~zero; // the lanes where p is still before the moving position
+			lane score = {};
+			for (int p = 0; p < 4; p++) {
+				lane at = (p < 3) ? (before & g[p]) : zero; // the lanes moving at p
+				lane v = (before != zero) ? ((at != zero) ? merged[p % 3] : a[p]) : a[p + 1];
+				if (p < 3) {
+					score |= lane(at & lane(a[p] != zero)) & merged[p];
+					before &= ~g[p];
+				}
+				moved |= lane(v != a[p]);
+				cell[line[i][p]] = v;
+			}
+			for (unsigned k = 0; k < width; k++) {
+				if (score[k]) reward[k] += (1 << score[k]);
+			}
+		}
+
+		uint32_t legal = 0;
+		for (unsigned k = 0; k < width; k++) {
+			if (moved[k]) legal |= (1u << k);
+			else reward[k] = -1;
+		}
+		return legal;
+	}
+
+private:
+	std::array<lane, 16> cell;
+};
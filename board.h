@@ -1,5 +1,7 @@
 #pragma once
+#include <algorithm>
 #include <array>
+#include <functional>
 #include <iostream>
 #include <iomanip>
 
@@ -127,6 +129,98 @@ public:
 		return score;
 	}
 
+	/**
+	 * pack the board into 64 bits, 4 bits per cell from (0) to (15), tiles are clamped to 15
+	 */
+	uint64_t pack() const {
+		uint64_t v = 0;
+		for (int i = 0; i < 4; i++) {
+			v |= uint64_t(line(tile[i][0], tile[i][1], tile[i][2], tile[i][3])) << (16 * i);
+		}
+		return v;
+	}
+
+	/**
+	 * restore a board from its packed form
+	 */
+	static board unpack(uint64_t v) {
+		board b;
+		for (int i = 0; i < 16; i++) b(i) = (v >> (4 * i)) & 0x0f;
+		return b;
+	}
+
+	/**
+	 * the canonical representative of the board under the 8 symmetries
+	 */
+	struct canonical_form {
+		uint64_t key; // the minimal packed image
+		unsigned transform; // the transform that produces the image, see transform()
+	};
+
+	/**
+	 * find the minimal packed image among all rotations and reflections
+	 * so that symmetric boards share the same key, ties go to the lower transform
+	 */
+	canonical_form canonical() const {
+		uint64_t v = pack(), h = packed_reflect_horizontal(v);
+		uint64_t image[8];
+		image[0] = v;
+		image[1] = packed_reflect_horizontal(packed_transpose(v)); // rotate right
+		image[2] = packed_reflect_vertical(h); // reverse
+		image[3] = packed_reflect_vertical(packed_transpose(v)); // rotate left
+		image[4] = h;
+		image[5] = packed_reflect_horizontal(packed_transpose(h));
+		image[6] = packed_reflect_vertical(packed_reflect_horizontal(h));
+		image[7] = packed_reflect_vertical(packed_transpose(h));
+		canonical_form form = { image[0], 0 };
+		for (unsigned i = 1; i < 8; i++) {
+			if (image[i] < form.key) form = { image[i], i };
+		}
+		return form;
+	}
+
+	/**
+	 * apply the i-th symmetric transform, using the same numbering as iso_pattern
+	 * reflect horizontally if i >= 4, then rotate clockwise i times
+	 */
+	void transform(unsigned i) {
+		if (i >= 4) reflect_horizontal();
+		rotate(i);
+	}
+
+	/**
+	 * 64-bit hash of the board, a murmur3 finalizer over the packed form
+	 */
+	uint64_t hash() const {
+		uint64_t h = pack();
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	/**
+	 * get the legal directions as a bitmask, bit i is set if slide(i) would be legal
+	 * e.g. 0b1010 means only right (1) and left (3) are legal
+	 */
+	unsigned legal_moves() const {
+		const auto& movable = movable_lines();
+		unsigned mask = 0;
+		for (int i = 0; i < 4; i++) {
+			unsigned row = movable[line(tile[i][0], tile[i][1], tile[i][2], tile[i][3])];
+			unsigned col = movable[line(tile[0][i], tile[1][i], tile[2][i], tile[3][i])];
+			mask |= ((row & 1) << 3) | ((row & 2) << 0) | ((col & 1) << 0) | ((col & 2) << 1);
+		}
+		return mask;
+	}
+
+	/**
+	 * return true if there is no legal slide
+	 */
+	bool is_terminal() const { return legal_moves() == 0; }
+
 	void transpose() {
 		for (int r = 0; r < 4; r++) {
 			for (int c = r + 1; c < 4; c++) {
@@ -178,7 +272,70 @@ public:
 		return out;
 	}
 
+private:
+	/**
+	 * pack four cells of a row (or a column) into a 16-bit key, tiles are clamped to 15
+	 */
+	static unsigned line(cell a, cell b, cell c, cell d) {
+		return std::min(a, 15u) | (std::min(b, 15u) << 4) | (std::min(c, 15u) << 8) | (std::min(d, 15u) << 12);
+	}
+
+	/**
+	 * symmetric operations on the packed form, see pack()
+	 */
+	static uint64_t packed_reflect_horizontal(uint64_t v) {
+		const auto& reverse = reversed_lines();
+		return uint64_t(reverse[v & 0xffff]) | (uint64_t(reverse[(v >> 16) & 0xffff]) << 16)
+			| (uint64_t(reverse[(v >> 32) & 0xffff]) << 32) | (uint64_t(reverse[v >> 48]) << 48);
+	}
+	static uint64_t packed_reflect_vertical(uint64_t v) {
+		return (v >> 48) | ((v >> 16) & 0xffff0000ull) | ((v << 16) & 0xffff00000000ull) | (v << 48);
+	}
+	static uint64_t packed_transpose(uint64_t v) {
+		uint64_t a = (v & 0xf0f00f0ff0f00f0full) | ((v & 0x0000f0f00000f0f0ull) << 12) | ((v >> 12) & 0x0000f0f00000f0f0ull);
+		return (a & 0xff00ff0000ff00ffull) | ((a >> 24) & 0x00000000ff00ff00ull) | ((a & 0x00000000ff00ff00ull) << 24);
+	}
+
+	/**
+	 * lookup table of all 16-bit lines with their cells in reversed order
+	 */
+	static const std::array<uint16_t, 65536>& reversed_lines() {
+		static const std::array<uint16_t, 65536> reverse = []() {
+			std::array<uint16_t, 65536> reverse;
+			for (unsigned v = 0; v < 65536; v++) {
+				reverse[v] = ((v & 0x000f) << 12) | ((v & 0x00f0) << 4) | ((v & 0x0f00) >> 4) | ((v & 0xf000) >> 12);
+			}
+			return reverse;
+		}();
+		return reverse;
+	}
+
+	/**
+	 * lookup table of all 16-bit lines
+	 * bit 0 is set if the line can slide toward its first cell (left, or up for a column)
+	 * bit 1 is set if the line can slide toward its last cell (right, or down for a column)
+	 */
+	static const std::array<uint8_t, 65536>& movable_lines() {
+		static const std::array<uint8_t, 65536> movable = []() {
+			std::array<uint8_t, 65536> movable;
+			for (unsigned v = 0; v < 65536; v++) {
+				board b;
+				for (int c = 0; c < 4; c++) b[0][c] = (v >> (4 * c)) & 0x0f;
+				board l = b, r = b;
+				movable[v] = (l.slide_left() != -1 ? 1 : 0) | (r.slide_right() != -1 ? 2 : 0);
+			}
+			return movable;
+		}();
+		return movable;
+	}
+
 private:
 	grid tile;
 	data attr;
 };
+
+namespace std {
+template<> struct hash<board> {
+	size_t operator ()(const board& b) const { return b.hash(); }
+};
+}
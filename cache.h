@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+/**
+ * fixed-size, lossy transposition cache
+ *
+ * the cache is direct-mapped on the 64-bit hash of the key, and only the hash is stored,
+ * a new entry simply replaces whatever was in its slot
+ * clear() is O(1), it advances the generation so that every older entry becomes a miss
+ *
+ * usage:
+ *  transposition<board, float> memo(20); // 2^20 entries
+ *  float v;
+ *  if (!memo.find(b, v)) memo.store(b, v = evaluation(b));
+ */
+template<typename key, typename value, typename hash = std::hash<key>>
+class transposition {
+public:
+	transposition(unsigned bits = 0) : table(bits ? size_t(1) << bits : 0), gen(1), hit(0), miss(0) {}
+
+public:
+	bool find(const key& k, value& v) {
+		if (table.empty()) return false;
+		uint64_t h = hash()(k);
+		const entry& e = table[h & (table.size() - 1)];
+		if (e.gen == gen && e.tag == h) {
+			v = e.val;
+			hit++;
+			return true;
+		}
+		miss++;
+		return false;
+	}
+
+	void store(const key& k, const value& v) {
+		if (table.empty()) return;
+		uint64_t h = hash()(k);
+		entry& e = table[h & (table.size() - 1)];
+		e.tag = h;
+		e.val = v;
+		e.gen = gen;
+	}
+
+	/**
+	 * invalidate all entries
+	 */
+	void clear() {
+		if (++gen == 0) { // wrapped around, the old tags must really be erased
+			for (entry& e : table) e.gen = 0;
+			gen = 1;
+		}
+	}
+
+	size_t size() const { return table.size(); }
+	size_t hits() const { return hit; }
+	size_t misses() const { return miss; }
+
+private:
+	struct entry {
+		uint64_t tag = 0;
+		value val = {};
+		uint32_t gen = 0;
+	};
+
+	std::vector<entry> table;
+	uint32_t gen;
+	size_t hit;
+	size_t miss;
+};
@@ -0,0 +1,304 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "agent.h"
+#include "statistic.h"
+
+/**
+ * periodic checkpoints of a training run, written by a background thread
+ *
+ * a checkpoint with prefix p consists of
+ *  p.weights: the weight tables, in the format of TD_player save= and load=, followed by the uint64 episodes of the checkpoint
+ *  p.stat:    the records of the last block, in the format of --save and --load
+ *  p.state:   the counters to resume from, "episodes=N seed=S game=G"
+ * since every game draws from its own streams (see random_agent), the random state
+ * at a game boundary is fully described by the seed and the index of the next game
+ * each file is written under a temporary name and then renamed, so a crash never leaves a broken checkpoint
+ * p.state is renamed first and marks a complete checkpoint; the weights are put in place only after it,
+ * so resume() can tell from the episodes of the weights whether they belong to p.state
+ *
+ * the tables are double-buffered: take() copies the 4KB blocks updated since the last snapshot
+ * into a private buffer and returns, then the buffer is written while the training goes on
+ * a snapshot is skipped (and retried after the next game) if the previous one is still being written
+ *
+ * only the first checkpoint of a run writes the whole p.weights, the later ones are incremental:
+ * the changed blocks are written to p.delta, which is then merged into p.weights in place and removed
+ * a p.delta (or p.weights.tmp) left by a crash is completed by resume() if it belongs to p.state, and discarded otherwise
+ *
+ * usage:
+ *  checkpoint ckpt("run", 10000, 600, stat.episodes()); // every 10000 games or 600 seconds
+ *  ...
+ *  if (ckpt.due(stat.episodes())) ckpt.take(play, stat, evil.base_seed(), evil.next_game());
+ */
+class checkpoint {
+public:
+	/**
+	 * the episodes are those of the run so far, e.g. those of the checkpoint it is resumed from,
+	 * so that the next checkpoint is due 'games' episodes after them
+	 */
+	checkpoint(const std::string& prefix = "", size_t games = 0, double seconds = 0, size_t episodes = 0)
+		: prefix(prefix), games(games), seconds(seconds), based(false), busy(false), last_games(episodes), last_time(clock::now()) {}
+	~checkpoint() { wait(); }
+
+	/**
+	 * whether a checkpoint should be taken after the given number of episodes
+	 */
+	bool due(size_t episodes) const {
+		if (prefix.empty()) return false;
+		if (games && episodes >= last_games + games) return true;
+		if (seconds && std::chrono::duration<double>(clock::now() - last_time).count() >= seconds) return true;
+		return false;
+	}
+
+	/**
+	 * snapshot the player and the statistic, and start writing them in the background
+	 * return false if the previous checkpoint is still being written
+	 */
+	bool take(TD_player& play, const statistic& stat, uint64_t seed, uint64_t game) {
+		if (busy) return false;
+		wait();
+
+		std::vector<iso_pattern>& net = play.network();
+		if (shadow.size() != net.size()) {
+			shadow.resize(net.size());
+			pending.resize(net.size());
+			based = false;
+		}
+		for (size_t i = 0; i < net.size(); i++) {
+			weight& w = net[i];
+			if (shadow[i].size != w.size()) {
+				shadow[i].size = w.size();
+				shadow[i].block.assign(w.blocks(), {});
+				pending[i].assign(w.blocks(), false);
+				w.touch_all();
+				based = false;
+			}
+			for (size_t blk = 0; blk < w.blocks(); blk++) {
+				if (!w.is_dirty(blk)) continue;
+				const float* data = w.block_data(blk);
+				if (data) shadow[i].block[blk].assign(data, data + w.block_size(blk));
+				else shadow[i].block[blk].clear();
+				pending[i][blk] = true;
+				w.clean(blk);
+			}
+		}
+		std::stringstream records, counters;
+		stat.save_recent(records);
+		counters << "episodes=" << stat.episodes() << " seed=" << seed << " game=" << game << std::endl;
+
+		last_games = stat.episodes();
+		last_time = clock::now();
+		busy = true;
+		writer = std::thread(&checkpoint::write, this, records.str(), counters.str(), uint64_t(stat.episodes()));
+		return true;
+	}
+
+	/**
+	 * block until the checkpoint being written (if any) is complete
+	 */
+	void wait() {
+		if (writer.joinable()) writer.join();
+	}
+
+	/**
+	 * read the counters of checkpoint p, i.e., the content of p.state,
+	 * and complete its weights by the pending p.weights.tmp or p.delta (if any) of the same episodes
+	 * the pending weights of other episodes were written by a checkpoint that crashed before its p.state, and are removed
+	 * return false if there is no such checkpoint, or if p.weights does not belong to it
+	 */
+	static bool resume(const std::string& prefix, size_t& episodes, uint64_t& seed, uint64_t& game) {
+		std::ifstream in(prefix + ".state");
+		std::string line;
+		if (!std::getline(in, line)) return false;
+		std::stringstream ss(line);
+		for (std::string pair; ss >> pair; ) {
+			std::string key = pair.substr(0, pair.find('='));
+			uint64_t value = std::stoull(pair.substr(pair.find('=') + 1));
+			if (key == "episodes") episodes = value;
+			if (key == "seed") seed = value;
+			if (key == "game") game = value;
+		}
+
+		std::string weights = prefix + ".weights", delta = prefix + ".delta";
+		if (stamp(weights + ".tmp") == episodes) std::rename((weights + ".tmp").c_str(), weights.c_str());
+		else std::remove((weights + ".tmp").c_str());
+		if (std::ifstream(delta).is_open()) {
+			uint64_t delta_episodes = -1;
+			std::ifstream(delta, std::ios::in | std::ios::binary).read(reinterpret_cast<char*>(&delta_episodes), sizeof(delta_episodes));
+			if (delta_episodes == episodes && !merge(weights, delta)) return false;
+			std::remove(delta.c_str());
+		}
+		return stamp(weights) == episodes;
+	}
+
+	/**
+	 * the episodes of a weight file of a checkpoint, i.e., the uint64 after its tables, or -1 if the file is incomplete
+	 */
+	static uint64_t stamp(const std::string& path) {
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		std::string sig(weight::signature().size(), '\0');
+		in.read(&sig[0], sig.size());
+		if (sig != weight::signature()) return -1;
+		uint32_t count = 0;
+		in.read(reinterpret_cast<char*>(&count), sizeof(count));
+		for (uint32_t i = 0; i < count && in; i++) {
+			uint64_t size = 0;
+			in.read(reinterpret_cast<char*>(&size), sizeof(size));
+			in.seekg(std::streamoff(sizeof(float) * size), std::ios::cur);
+		}
+		uint64_t episodes = -1;
+		in.read(reinterpret_cast<char*>(&episodes), sizeof(episodes));
+		return in ? episodes : -1;
+	}
+
+	/**
+	 * merge a delta file into a base weight file in place
+	 *
+	 * the base has the fixed layout of TD_player save=, followed by the episodes, i.e.,
+	 *  char[8] weight::signature(), uint32 count, then for each table: uint64 size, float[size], then uint64 episodes
+	 * the delta has
+	 *  uint64 episodes, uint32 count, then for each table: uint64 size, uint64 n, then n times: uint64 block, float[1024]
+	 * where the last block of a table is cut at its size
+	 * the episodes of the base are set to those of the delta once all its blocks are written
+	 * return false if the files are unreadable or their layouts do not match
+	 */
+	static bool merge(const std::string& base, const std::string& delta) {
+		std::fstream out(base, std::ios::in | std::ios::out | std::ios::binary);
+		std::ifstream in(delta, std::ios::in | std::ios::binary);
+		uint64_t episodes = 0;
+		uint32_t count = 0, base_count = 0;
+		in.read(reinterpret_cast<char*>(&episodes), sizeof(episodes));
+		in.read(reinterpret_cast<char*>(&count), sizeof(count));
+		std::string sig(weight::signature().size(), '\0');
+		out.read(&sig[0], sig.size());
+		out.read(reinterpret_cast<char*>(&base_count), sizeof(base_count));
+		if (!in || !out || sig != weight::signature() || count != base_count) return false;
+		std::streamoff offset = sig.size() + sizeof(uint32_t);
+		std::vector<float> buf(weight::block);
+		for (uint32_t i = 0; i < count; i++) {
+			uint64_t size = 0, base_size = 0, n = 0;
+			in.read(reinterpret_cast<char*>(&size), sizeof(size));
+			in.read(reinterpret_cast<char*>(&n), sizeof(n));
+			out.seekg(offset);
+			out.read(reinterpret_cast<char*>(&base_size), sizeof(base_size));
+			if (!in || !out || size != base_size) return false;
+			offset += sizeof(uint64_t);
+			while (n--) {
+				uint64_t blk = 0;
+				in.read(reinterpret_cast<char*>(&blk), sizeof(blk));
+				uint64_t lo = blk * weight::block, len = std::min<uint64_t>(weight::block, size - lo);
+				in.read(reinterpret_cast<char*>(buf.data()), sizeof(float) * len);
+				out.seekp(offset + std::streamoff(sizeof(float) * lo));
+				out.write(reinterpret_cast<const char*>(buf.data()), sizeof(float) * len);
+			}
+			offset += sizeof(float) * size;
+		}
+		if (!in) return false;
+		out.seekp(offset);
+		out.write(reinterpret_cast<const char*>(&episodes), sizeof(episodes));
+		out.flush();
+		return in.good() && out.good();
+	}
+
+private:
+	void write(std::string records, std::string counters, uint64_t episodes) {
+		bool good = (based ? write_delta(episodes) : write_full(episodes)) && write_text(".stat", records) && write_text(".state", counters);
+		// the counters mark a complete checkpoint, the weights are put in place after that
+		if (good && based) {
+			good = merge(prefix + ".weights", prefix + ".delta");
+			if (good) std::remove((prefix + ".delta").c_str());
+		} else if (good) {
+			good = std::rename((prefix + ".weights.tmp").c_str(), (prefix + ".weights").c_str()) == 0;
+		}
+		if (good) {
+			for (auto& blocks : pending) blocks.assign(blocks.size(), false);
+			based = true;
+		} else {
+			error << "checkpoint " << prefix << " failed" << std::endl;
+			based = false; // write the whole weights next time
+		}
+		busy = false;
+	}
+
+	/**
+	 * write the whole weights to p.weights.tmp, which is renamed to p.weights by write() after p.state
+	 */
+	bool write_full(uint64_t episodes) {
+		std::ofstream out(prefix + ".weights.tmp", std::ios::out | std::ios::binary | std::ios::trunc);
+		uint32_t count = shadow.size();
+		out.write(weight::signature().data(), weight::signature().size());
+		out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		for (const table& tab : shadow) {
+			out.write(reinterpret_cast<const char*>(&tab.size), sizeof(tab.size));
+			for (uint64_t blk = 0; blk < tab.block.size(); blk++) tab.write(out, blk);
+		}
+		out.write(reinterpret_cast<const char*>(&episodes), sizeof(episodes));
+		out.close();
+		return out.good();
+	}
+
+	bool write_delta(uint64_t episodes) {
+		std::ofstream out(prefix + ".delta.tmp", std::ios::out | std::ios::binary | std::ios::trunc);
+		uint32_t count = shadow.size();
+		out.write(reinterpret_cast<const char*>(&episodes), sizeof(episodes));
+		out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		for (size_t i = 0; i < shadow.size(); i++) {
+			uint64_t n = std::count(pending[i].begin(), pending[i].end(), true);
+			out.write(reinterpret_cast<const char*>(&shadow[i].size), sizeof(shadow[i].size));
+			out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+			for (uint64_t blk = 0; blk < pending[i].size(); blk++) {
+				if (!pending[i][blk]) continue;
+				out.write(reinterpret_cast<const char*>(&blk), sizeof(blk));
+				shadow[i].write(out, blk);
+			}
+		}
+		out.close();
+		return out.good() && std::rename((prefix + ".delta.tmp").c_str(), (prefix + ".delta").c_str()) == 0;
+	}
+
+	bool write_text(const std::string& suffix, const std::string& text) {
+		std::ofstream out(prefix + suffix + ".tmp", std::ios::out | std::ios::trunc);
+		out << text;
+		out.close();
+		return out.good() && std::rename((prefix + suffix + ".tmp").c_str(), (prefix + suffix).c_str()) == 0;
+	}
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	std::string prefix;
+	size_t games;
+	double seconds;
+
+	/**
+	 * the snapshot of a table, block by block; an empty block is all zeros (an unallocated sparse block)
+	 */
+	struct table {
+		uint64_t size = 0;
+		std::vector<std::vector<float>> block;
+
+		void write(std::ostream& out, uint64_t blk) const {
+			uint64_t len = std::min<uint64_t>(weight::block, size - blk * weight::block);
+			if (block[blk].empty()) {
+				const std::vector<float> zero(len);
+				out.write(reinterpret_cast<const char*>(zero.data()), sizeof(float) * len);
+			} else {
+				out.write(reinterpret_cast<const char*>(block[blk].data()), sizeof(float) * len);
+			}
+		}
+	};
+	std::vector<table> shadow;
+	std::vector<std::vector<bool>> pending; // the blocks of shadow not yet written
+	bool based; // whether p.weights holds the shadow as of the last checkpoint
+	std::thread writer;
+	std::atomic<bool> busy;
+	size_t last_games;
+	clock::time_point last_time;
+};
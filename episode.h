@@ -124,20 +124,22 @@ public:
 protected:
 
 	struct move {
-		action code;
+		action::packed code; // see action::pack
 		board::reward reward;
 		time_t time;
-		move(action code = {}, board::reward reward = 0, time_t time = 0) : code(code), reward(reward), time(time) {}
+		move(action code = {}, board::reward reward = 0, time_t time = 0) : code(code.pack()), reward(reward), time(time) {}
 
-		operator action() const { return code; }
+		operator action() const { return action::unpack(code); }
 		friend std::ostream& operator <<(std::ostream& out, const move& m) {
-			out << m.code;
+			out << action(m);
 			if (m.reward) out << '[' << std::dec << m.reward << ']';
 			if (m.time) out << '(' << std::dec << m.time << ')';
 			return out;
 		}
 		friend std::istream& operator >>(std::istream& in, move& m) {
-			in >> m.code;
+			action code;
+			in >> code;
+			m.code = code.pack();
 			m.reward = 0;
 			m.time = 0;
 			if (in.peek() == '[') {
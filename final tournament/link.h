@@ -0,0 +1,211 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * a direct connection of the shell to the arena server, in place of the arena-link and arena-ctrl scripts
+ *
+ * the lines from the server are handed to the shell by next(), and the replies of the shell are sent by send()
+ * the traffic is displayed as arena-link does, "<< " for the lines sent to the server and ">> " for the lines from it
+ * the terminal works as the control panel of arena-ctrl: a line typed with "<< " is sent to the server,
+ * a line with ">> " is handed to the shell, a line with "<> " goes to both, and a line without a prefix follows the last one
+ *
+ * the socket and the terminal are served by one epoll loop in the shell process, so a move costs no process or pipe
+ * note that the connection is plain TCP, an arena behind TLS needs a local terminator (e.g., ncat --ssl or stunnel)
+ *
+ * usage:
+ *  arena_link link("127.0.0.1:32768");
+ *  for (std::string line; link.next(line); ) link.send(reply_of(line));
+ */
+class arena_link {
+public:
+	arena_link(const std::string& address, bool echo = true) : sock(-1), poll(-1), writing(false), echo(echo), last("<< ") {
+		std::string host = address.substr(0, address.rfind(':'));
+		std::string port = address.substr(address.rfind(':') + 1);
+		if (host.size() > 1 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2); // e.g. [::1]:32768
+		addrinfo hints = {}, *res = nullptr;
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+		if (err) throw std::runtime_error("arena " + address + ": " + gai_strerror(err));
+		for (addrinfo* ai = res; ai && sock < 0; ai = ai->ai_next) {
+			sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+			if (sock >= 0 && connect(sock, ai->ai_addr, ai->ai_addrlen) != 0) {
+				err = errno;
+				close(sock);
+				sock = -1;
+			}
+		}
+		freeaddrinfo(res);
+		if (sock < 0) throw std::runtime_error("arena " + address + ": " + std::strerror(err ? err : errno));
+
+		int one = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // the moves are short lines, send them at once
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+		poll = epoll_create1(0);
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.fd = sock;
+		epoll_ctl(poll, EPOLL_CTL_ADD, sock, &ev);
+		ev.data.fd = STDIN_FILENO;
+		epoll_ctl(poll, EPOLL_CTL_ADD, STDIN_FILENO, &ev); // fails for a regular file or /dev/null, which are not a control panel
+		std::cout << "arena-link: " << address << " <--> shell" << std::endl;
+	}
+	arena_link(const arena_link&) = delete;
+	arena_link& operator =(const arena_link&) = delete;
+	~arena_link() {
+		if (poll >= 0) close(poll);
+		if (sock >= 0) close(sock);
+	}
+
+	/**
+	 * wait for the next line to the shell
+	 * return false once the server has closed the connection and all its lines are taken
+	 */
+	bool next(std::string& line) {
+		while (inbox.empty()) {
+			if (sock < 0) return false;
+			epoll_event events[2];
+			int n = epoll_wait(poll, events, 2, -1);
+			if (n < 0 && errno != EINTR) return false;
+			for (int i = 0; i < n; i++) {
+				if (events[i].data.fd != sock) {
+					control();
+				} else {
+					if (events[i].events & EPOLLOUT) flush();
+					if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) receive();
+				}
+			}
+		}
+		line = inbox.front();
+		inbox.pop_front();
+		return true;
+	}
+
+	/**
+	 * send some lines to the server, the rest of them is sent by next() if the socket is full
+	 */
+	void send(const std::string& text) {
+		if (text.empty() || sock < 0) return;
+		if (echo) display("<< ", text);
+		outbox += text;
+		flush();
+	}
+
+private:
+	void flush() {
+		size_t done = 0;
+		while (done < outbox.size()) {
+			ssize_t n = ::send(sock, outbox.data() + done, outbox.size() - done, MSG_NOSIGNAL);
+			if (n > 0) {
+				done += n;
+			} else if (n < 0 && errno == EINTR) {
+				continue;
+			} else {
+				break;
+			}
+		}
+		outbox.erase(0, done);
+		if (writing != !outbox.empty()) { // wait for the socket to be writable only while something is left
+			writing = !outbox.empty();
+			epoll_event ev = {};
+			ev.events = writing ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+			ev.data.fd = sock;
+			epoll_ctl(poll, EPOLL_CTL_MOD, sock, &ev);
+		}
+	}
+
+	void receive() {
+		char buf[65536];
+		for (;;) {
+			ssize_t n = ::recv(sock, buf, sizeof(buf), 0);
+			if (n > 0) {
+				for (std::string& line : split(incoming, buf, n)) {
+					if (echo) display(">> ", line);
+					inbox.push_back(line);
+				}
+			} else if (n < 0 && errno == EINTR) {
+				continue;
+			} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				return;
+			} else { // closed by the server, or broken
+				if (incoming.size()) inbox.push_back(incoming);
+				incoming.clear();
+				close(sock);
+				sock = -1;
+				std::cout << "arena-link: closed" << std::endl;
+				return;
+			}
+		}
+	}
+
+	/**
+	 * the lines typed to the control panel, see arena_link
+	 */
+	void control() {
+		char buf[4096];
+		ssize_t n = ::read(STDIN_FILENO, buf, sizeof(buf));
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR) return;
+			epoll_ctl(poll, EPOLL_CTL_DEL, STDIN_FILENO, nullptr); // the terminal is closed, keep the connection
+			return;
+		}
+		for (std::string& line : split(typed, buf, n)) {
+			std::string prefix = line.substr(0, 3);
+			if (prefix == "<< " || prefix == ">> " || prefix == "<> ") {
+				last = prefix;
+				line = line.substr(3);
+			}
+			if (last != ">> ") send(line + "\n");
+			if (last != "<< ") inbox.push_back(line);
+		}
+	}
+
+	/**
+	 * append the data to the pending text, and take the complete lines out of it without their line breaks
+	 */
+	static std::deque<std::string> split(std::string& pending, const char* data, size_t size) {
+		std::deque<std::string> lines;
+		pending.append(data, size);
+		size_t begin = 0;
+		for (size_t end; (end = pending.find('\n', begin)) != std::string::npos; begin = end + 1) {
+			size_t len = end - begin;
+			if (len && pending[end - 1] == '\r') len--;
+			lines.push_back(pending.substr(begin, len));
+		}
+		pending.erase(0, begin);
+		return lines;
+	}
+
+	static void display(const std::string& prefix, const std::string& text) {
+		size_t begin = 0;
+		for (size_t end; begin < text.size(); begin = end + 1) {
+			end = text.find('\n', begin);
+			if (end == std::string::npos) end = text.size();
+			std::cout << prefix << text.substr(begin, std::min<size_t>(end - begin, 2048)) << '\n';
+		}
+		std::cout << std::flush;
+	}
+
+private:
+	int sock;
+	int poll;
+	bool writing;
+	bool echo;
+	std::string last; // the last prefix typed to the control panel
+	std::string incoming, typed; // the incomplete lines from the server and the terminal
+	std::string outbox;
+	std::deque<std::string> inbox;
+};
@@ -19,9 +19,11 @@
 #include "statistic.h"
 #include "arena.h"
 #include "io.h"
+#include "link.h"
 
 int shell(int argc, const char* argv[]) {
 	arena host("anonymous");
+	std::string address;
 
 	for (int i = 1; i < argc; i++) {
 		std::string para(argv[i]);
@@ -31,6 +33,8 @@ int shell(int argc, const char* argv[]) {
 			host.set_login(para.substr(para.find("=") + 1));
 		} else if (para.find("--save=") == 0 || para.find("--dump=") == 0) {
 			host.set_dump_file(para.substr(para.find("=") + 1));
+		} else if (para.find("--arena=") == 0) { // connect to the arena host:port directly, instead of stdin and stdout
+			address = para.substr(para.find("=") + 1);
 		} else if (para.find("--play") == 0) {
 			std::shared_ptr<agent> play(new TD_player(para.substr(para.find("=") + 1)));//CHANGE
 			host.register_agent(play);
@@ -45,7 +49,8 @@ int shell(int argc, const char* argv[]) {
 	std::regex arena_ctrl("^[@$].+$"); // e.g. "@ login", "@ error the account "Name" has already been taken"
 	std::regex arena_info("^[?%].+$"); // e.g. "? message from anonymous: 2048!!!"
 
-	for (std::string command; input() >> command; ) {
+	// handle a command, and write the replies to out; return false to leave the shell
+	auto serve = [&](const std::string& command, std::ostream& out) -> bool {
 		try {
 			if (std::regex_match(command, match_move)) {
 				std::string id, move;
@@ -58,9 +63,9 @@ int shell(int argc, const char* argv[]) {
 					//if(host.at(id).apply_action(a) != true) host.at(id).new_game();
 					if(a.type()==action::place::type){
 						int hint = host.at(id).hint();
-						output() << id << ' ' << a << '+'<< hint << std::endl;
+						output("", out) << id << ' ' << a << '+'<< hint << std::endl;
 					} else {
-						output() << id << ' ' << a << std::endl;
+						output("", out) << id << ' ' << a << std::endl;
 					}
 					
 				} else {
@@ -84,9 +89,9 @@ int shell(int argc, const char* argv[]) {
 				if (ctrl == "open") {
 					// a new match is pending
 					if (host.open(id, tag)) {
-						output() << id << " open accept" << std::endl;
+						output("", out) << id << " open accept" << std::endl;
 					} else {
-						output() << id << " open reject" << std::endl;
+						output("", out) << id << " open reject" << std::endl;
 					}
 				} else if (ctrl == "close") {
 					// a match is finished
@@ -103,7 +108,7 @@ int shell(int argc, const char* argv[]) {
 					for (auto who : host.list_agents()) {
 						agents << " " << who->name() << "(" << who->role() << ")";
 					}
-					output("@ ") << "login " << host.login() << agents.str() << std::endl;
+					output("@ ", out) << "login " << host.login() << agents.str() << std::endl;
 
 				} else if (ctrl == "status") {
 					// display current local status
@@ -123,7 +128,7 @@ int shell(int argc, const char* argv[]) {
 					// some error messages or exit command
 					std::string message = command.substr(command.find_first_not_of("@$ "));
 					info << message << std::endl;
-					break;
+					return false;
 				}
 
 			} else if (std::regex_match(command, arena_info)) {
@@ -132,8 +137,24 @@ int shell(int argc, const char* argv[]) {
 		} catch (std::exception& ex) {
 			std::string message = std::string(typeid(ex).name()) + ": " + ex.what();
 			message = message.substr(0, message.find_first_of("\r\n"));
-			output("? ") << "exception " << message << " at \"" << command << "\"" << std::endl;
+			output("? ", out) << "exception " << message << " at \"" << command << "\"" << std::endl;
+		}
+		return true;
+	};
+
+	if (address.size()) {
+		arena_link link(address);
+		for (std::string command; link.next(command); ) {
+			std::stringstream replies;
+			bool more = serve(command, replies);
+			link.send(replies.str());
+			if (!more) break;
 		}
+		return 0;
+	}
+
+	for (std::string command; input() >> command; ) {
+		if (!serve(command, std::cout)) break;
 	}
 
 	return 0;
@@ -0,0 +1,181 @@
+#pragma once
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+/**
+ * allocator for large weight tables, backed by huge pages and optionally interleaved over NUMA nodes
+ *
+ * the policy is global and should be set before the tables are created, e.g.
+ *  table_policy::current().page = table_policy::huge_2m;
+ *  table_policy::current().interleave = true;
+ * tables smaller than 2MB, or with page == normal, are allocated by operator new as usual, unless they are interleaved,
+ * since the interleave policy is applied by mbind() to a mapping of their own
+ *
+ * page sizes are tried in order: hugetlbfs (1GB or 2MB, needs reserved pages in /proc/sys/vm/nr_hugepages),
+ * then transparent huge pages by madvise(MADV_HUGEPAGE), then normal pages;
+ * use table_policy::report() to see what a table actually got
+ */
+struct table_policy {
+	enum page_type { normal, thp, huge_2m, huge_1g };
+	page_type page = normal;
+	bool interleave = false;
+
+	static table_policy& current() {
+		static table_policy policy;
+		return policy;
+	}
+
+	/**
+	 * the tables mapped by map(), keyed by their start address
+	 */
+	struct region {
+		size_t length;
+		const char* via;
+	};
+	static std::map<const void*, region>& regions() {
+		static std::map<const void*, region> m;
+		return m;
+	}
+
+	/**
+	 * describe the page size and the NUMA placement of the table starting at p, for example
+	 *  "thp, 4kB pages, 43008kB huge, interleave:0-1 N0=5504 N1=5503"
+	 * the numbers come from /proc/self/smaps and /proc/self/numa_maps, so touch the table first
+	 */
+	static std::string report(const void* p) {
+		auto it = regions().find(p);
+		std::stringstream res;
+		res << (it != regions().end() ? it->second.via : "heap");
+
+		uintptr_t addr = reinterpret_cast<uintptr_t>(p), vma = 0;
+		std::ifstream smaps("/proc/self/smaps");
+		bool found = false;
+		for (std::string line; std::getline(smaps, line); ) {
+			uintptr_t lo, hi;
+			char dash;
+			if (std::isxdigit(line[0]) && std::stringstream(line) >> std::hex >> lo >> dash >> hi) {
+				found = (lo <= addr && addr < hi);
+				if (found) vma = lo;
+			} else if (found && line.find("KernelPageSize:") == 0) {
+				res << ", " << std::stoul(line.substr(15)) << "kB pages";
+			} else if (found && line.find("AnonHugePages:") == 0) {
+				res << ", " << std::stoul(line.substr(14)) << "kB huge";
+			}
+		}
+
+		std::ifstream numa("/proc/self/numa_maps");
+		for (std::string line; std::getline(numa, line); ) {
+			std::stringstream ss(line);
+			uintptr_t lo;
+			std::string policy, token, nodes;
+			if (!(ss >> std::hex >> lo >> policy) || lo != vma) continue;
+			while (ss >> token) if (token[0] == 'N' && token.find('=') != std::string::npos) nodes += " " + token;
+			res << ", " << policy << nodes;
+		}
+		return res.str();
+	}
+
+	/**
+	 * map an anonymous region of n bytes according to the policy
+	 */
+	static void* map(size_t n) {
+		const table_policy& pol = current();
+		void* p = MAP_FAILED;
+		const char* via = "normal";
+		if (pol.page == huge_1g) {
+			size_t len = (n + (size_t(1) << 30) - 1) & ~((size_t(1) << 30) - 1);
+			p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (30 << MAP_HUGE_SHIFT), -1, 0);
+			if (p != MAP_FAILED) n = len, via = "hugetlb 1GB";
+		}
+		if (p == MAP_FAILED && pol.page >= huge_2m) {
+			size_t len = (n + (size_t(1) << 21) - 1) & ~((size_t(1) << 21) - 1);
+			p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+			if (p != MAP_FAILED) n = len, via = "hugetlb 2MB";
+		}
+		if (p == MAP_FAILED) {
+			// a trailing guard page keeps the kernel from merging adjacent tables into one mapping,
+			// so that report() can tell them apart; thp needs whole 2MB pages aligned at 2MB, normal pages are 4kB
+			// the mapping is made larger by the alignment, and the parts before and after the aligned table are unmapped
+			size_t align = pol.page != normal ? (size_t(1) << 21) : 4096;
+			n = (n + align - 1) & ~(align - 1);
+			size_t len = n + align;
+			char* raw = static_cast<char*>(mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+			if (raw == MAP_FAILED) throw std::bad_alloc();
+			char* start = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + align - 1) & ~(align - 1));
+			if (start != raw) munmap(raw, start - raw);
+			if (raw + len != start + n + 4096) munmap(start + n + 4096, (raw + len) - (start + n + 4096));
+			p = start;
+			mprotect(start + n, 4096, PROT_NONE);
+			n += 4096;
+#ifdef MADV_HUGEPAGE
+			if (pol.page != normal && madvise(p, n - 4096, MADV_HUGEPAGE) == 0) via = "thp";
+#endif
+		}
+		if (pol.interleave) {
+			unsigned long mask = online_nodes();
+			if (mask & (mask - 1)) { // more than one node
+				const int MPOL_INTERLEAVE = 3;
+				if (syscall(SYS_mbind, p, n, MPOL_INTERLEAVE, &mask, sizeof(mask) * 8, 0) != 0) via = "normal (mbind failed)";
+			}
+		}
+		regions()[p] = { n, via };
+		return p;
+	}
+
+	static void unmap(void* p) {
+		auto it = regions().find(p);
+		munmap(p, it->second.length);
+		regions().erase(it);
+	}
+
+	/**
+	 * the bitmask of online NUMA nodes, e.g. "0-1" in /sys/devices/system/node/online gives 0b11
+	 */
+	static unsigned long online_nodes() {
+		std::ifstream in("/sys/devices/system/node/online");
+		unsigned long mask = 0;
+		for (std::string range; std::getline(in, range, ','); ) {
+			unsigned lo = std::stoul(range), hi = lo;
+			if (range.find('-') != std::string::npos) hi = std::stoul(range.substr(range.find('-') + 1));
+			for (unsigned i = lo; i <= hi && i < sizeof(mask) * 8; i++) mask |= (1ul << i);
+		}
+		return mask ? mask : 1;
+	}
+};
+
+template<typename type>
+class table_allocator {
+public:
+	typedef type value_type;
+
+	table_allocator() = default;
+	template<typename other> table_allocator(const table_allocator<other>&) {}
+
+	type* allocate(size_t n) {
+		size_t bytes = n * sizeof(type);
+		const table_policy& pol = table_policy::current();
+		if (!pol.interleave && (pol.page == table_policy::normal || bytes < (size_t(1) << 21)))
+			return static_cast<type*>(::operator new(bytes));
+		return static_cast<type*>(table_policy::map(bytes));
+	}
+	void deallocate(type* p, size_t) {
+		if (table_policy::regions().count(p)) table_policy::unmap(p);
+		else ::operator delete(p);
+	}
+
+	template<typename other> bool operator ==(const table_allocator<other>&) const { return true; }
+	template<typename other> bool operator !=(const table_allocator<other>&) const { return false; }
+};
@@ -0,0 +1,125 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+/**
+ * per-phase timers and counters for the game loop
+ *
+ * the hooks are compiled out unless PROFILE is defined, e.g.
+ *  g++ -std=c++11 -O3 -DPROFILE -o threes threes.cpp
+ * define PROFILE_SAMPLE=n to time only one of every n calls of each phase,
+ * the call counters are always exact and the time is scaled accordingly
+ *
+ * usage:
+ *  PROFILE_SCOPE(evaluate); // attribute the rest of this block to 'evaluate'
+ *  PROFILE_REPORT(std::cout); // print and reset the breakdown
+ */
+class profiler {
+public:
+	enum phase { generate, evaluate, place, update, bookkeep, phases };
+	typedef std::chrono::steady_clock clock;
+
+	static profiler& instance() {
+		static profiler prof;
+		return prof;
+	}
+
+	struct record {
+		size_t calls = 0;
+		size_t samples = 0;
+		clock::duration time = clock::duration::zero();
+
+		/**
+		 * the estimated time (in ms) of all calls, scaled up from the samples
+		 */
+		double elapsed() const {
+			double ms = std::chrono::duration<double, std::milli>(time).count();
+			return samples ? ms * calls / samples : 0;
+		}
+	};
+
+	/**
+	 * scoped timer, attribute its lifetime to the given phase
+	 */
+	class scope {
+	public:
+		scope(phase p) : rec(instance().stat[p]), sampled((rec.calls++ % sample) == 0) {
+			if (sampled) start = clock::now();
+		}
+		~scope() {
+			if (sampled) rec.time += clock::now() - start, rec.samples++;
+		}
+		scope(const scope&) = delete;
+		scope& operator =(const scope&) = delete;
+	private:
+		record& rec;
+		bool sampled;
+		clock::time_point start;
+	};
+
+public:
+	void reset() {
+		for (auto& rec : stat) rec = {};
+		since = clock::now();
+	}
+
+	/**
+	 * show the breakdown since last reset
+	 *
+	 * the format would be
+	 *        phase      calls   time(ms) ns/call  share
+	 *        generate   1127845 120      106      18.4%
+	 *        ...
+	 *        other      -       35       -        5.3%
+	 *
+	 * where 'share' is relative to the wall time since last reset,
+	 * and 'other' is the time spent outside all profiled phases
+	 */
+	void show(std::ostream& out = std::cout) const {
+		static const char* name[phases] = { "generate", "evaluate", "place", "update", "bookkeep" };
+		double wall = std::chrono::duration<double, std::milli>(clock::now() - since).count();
+		double sum = 0;
+
+		std::ios ff(nullptr);
+		ff.copyfmt(out);
+		out << std::fixed << std::setprecision(1) << std::left;
+		out << "\t" << std::setw(10) << "phase" << std::setw(12) << "calls";
+		out << std::setw(10) << "time(ms)" << std::setw(9) << "ns/call" << "share" << std::endl;
+		for (int p = 0; p < phases; p++) {
+			const record& rec = stat[p];
+			double time = rec.elapsed();
+			sum += time;
+			out << "\t" << std::setw(10) << name[p] << std::setw(12) << rec.calls;
+			out << std::setw(10) << time << std::setw(9) << (rec.calls ? time * 1e6 / rec.calls : 0);
+			out << (wall > 0 ? time * 100 / wall : 0) << "%" << std::endl;
+		}
+		out << "\t" << std::setw(10) << "other" << std::setw(12) << "-";
+		out << std::setw(10) << std::max(wall - sum, 0.0) << std::setw(9) << "-";
+		out << (wall > 0 ? std::max(wall - sum, 0.0) * 100 / wall : 0) << "%" << std::endl;
+		out << std::endl;
+		out.copyfmt(ff);
+	}
+
+private:
+	profiler() { reset(); }
+
+	std::array<record, phases> stat;
+	clock::time_point since;
+
+#ifdef PROFILE_SAMPLE
+	static constexpr size_t sample = PROFILE_SAMPLE;
+#else
+	static constexpr size_t sample = 1;
+#endif
+};
+
+#ifdef PROFILE
+#define PROFILE_SCOPE(p) profiler::scope profile_scope(profiler::p)
+#define PROFILE_REPORT(out) (profiler::instance().show(out), profiler::instance().reset())
+#else
+#define PROFILE_SCOPE(p)
+#define PROFILE_REPORT(out)
+#endif
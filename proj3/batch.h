@@ -0,0 +1,201 @@
+#pragma once
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "solver.h"
+
+/**
+ * answer large batches of queries against a solved table
+ *
+ * the text format is the one of the interactive mode, i.e., lines of "b 0 1 2 3 6 0 +1",
+ * answered by the same lines as the interactive mode, but the input is parsed by hand from large blocks,
+ * the tile values are converted by a table, and the answers are formatted into a buffer
+ *
+ * the binary format has records of fixed size:
+ *  request:  uint8 type ('b' or 'a'), uint8 hint (1 to 3), uint8 tile[cells] as indices (e.g., 4 for 6)
+ *  response: float min, float max, double avg, all NaN for an unreachable or illegal state
+ * a query with a hint other than 1 to 3 (e.g., "+x" in the text format) is invalid, and is answered as an unreachable state
+ *
+ * usage:
+ *  query_batch<2, 3, 10> batch(solve);
+ *  batch.text(stdin, stdout);
+ */
+template<unsigned rows, unsigned cols, unsigned cap>
+class query_batch {
+public:
+	typedef basic_solver<rows, cols, cap> solver_type;
+	typedef typename solver_type::board_type board_type;
+	typedef typename solver_type::answer answer;
+	typedef typename solver_type::packed_answer packed_answer;
+
+	query_batch(solver_type& solve) : solve(solve) {
+		for (unsigned v = 0; v < sizeof(index) / sizeof(index[0]); v++)
+			index[v] = v <= 3 ? v : 3 + log2_floor(v / 3);
+	}
+
+	/**
+	 * answer the text queries until the end of the input, return the number of queries
+	 */
+	size_t text(std::FILE* in, std::FILE* out) {
+		std::vector<char> buf(1 << 20);
+		size_t count = 0, kept = 0;
+		for (bool last = false; !last; ) {
+			size_t end = kept + std::fread(buf.data() + kept, 1, buf.size() - kept, in);
+			last = end == kept;
+			// parse the complete lines only, unless it is the end of the input
+			size_t stop = end;
+			while (!last && stop > 0 && buf[stop - 1] != '\n') stop--;
+			if (!last && stop == 0) {
+				kept = end;
+				buf.resize(buf.size() * 2);
+				continue;
+			}
+			board_type board;
+			char type;
+			for (const char* p = buf.data(); parse(p, buf.data() + stop, type, board); count++) {
+				reply(type, board);
+				if (output.size() >= (1 << 20)) flush(out);
+			}
+			kept = end - stop;
+			std::memmove(buf.data(), buf.data() + stop, kept);
+		}
+		flush(out);
+		return count;
+	}
+
+	/**
+	 * answer the binary queries until the end of the input, return the number of queries
+	 */
+	size_t binary(std::FILE* in, std::FILE* out) {
+		const size_t size = 2 + board_type::cells, block = 65536;
+		std::vector<unsigned char> request(size * block);
+		std::vector<packed_answer> response(block);
+		size_t count = 0;
+		for (size_t n; (n = std::fread(request.data(), size, block, in)) > 0; count += n) {
+			for (size_t k = 0; k < n; k++) {
+				const unsigned char* r = request.data() + size * k;
+				board_type board;
+				board.info(r[1]);
+				for (unsigned i = 0; i < board_type::cells; i++) board(i) = r[2 + i];
+				response[k] = legal(board) && valid_hint(board) ? solve.solve(board, state_type(state_type::type(r[0]))) : answer();
+			}
+			std::fwrite(response.data(), sizeof(packed_answer), n, out);
+		}
+		std::fflush(out);
+		return count;
+	}
+
+private:
+	static unsigned log2_floor(unsigned v) { return 31 - __builtin_clz(v); }
+
+	unsigned tile_of(unsigned value) const {
+		return value < sizeof(index) / sizeof(index[0]) ? index[value] : 3 + log2_floor(value / 3);
+	}
+
+	static bool legal(const board_type& board) {
+		for (unsigned i = 0; i < board_type::cells; i++)
+			if (board(i) >= cap) return false;
+		return true;
+	}
+
+	/**
+	 * the tables are indexed by hint - 1, so any other hint would read the slot of another state
+	 */
+	static bool valid_hint(const board_type& board) {
+		return board.info() >= 1 && board.info() <= 3;
+	}
+
+	/**
+	 * parse the next query before end, in the same way as the stream operators of the interactive mode
+	 * return false if there is no complete query
+	 */
+	bool parse(const char*& p, const char* end, char& type, board_type& board) const {
+		while (p != end && std::isspace(*p)) p++;
+		if (p == end) return false;
+		type = *p;
+		while (p != end && !std::isspace(*p)) p++;
+		for (unsigned i = 0; i < board_type::cells; i++) {
+			while (p != end && !std::isdigit(*p)) p++;
+			if (p == end) return false;
+			unsigned value = 0;
+			while (p != end && std::isdigit(*p)) value = value * 10 + (*p++ - '0');
+			board(i) = tile_of(value);
+		}
+		while (p != end && *p != '+') p++;
+		if (p != end) p++;
+		while (p != end && std::isspace(*p)) p++;
+		if (p == end) return false;
+		board.info(*p != 'x' ? *p - '0' : 0);
+		p++;
+		return true;
+	}
+
+	void reply(char type, const board_type& board) {
+		answer ans;
+		if (!legal(board)) output += " illegal board\n";
+		else if (valid_hint(board)) ans = solve.solve(board, state_type(state_type::type(type)));
+
+		output += type;
+		output += ' ';
+		for (unsigned i = 0; i < board_type::cells; i++) {
+			unsigned t = board(i);
+			put(t > 3 ? ((1 << (t - 3)) * 3) : t);
+			output += ' ';
+		}
+		output += '+';
+		output += board.info() ? char(board.info() + '0') : 'x';
+		output += " = ";
+		if (std::isnan(ans.avg)) {
+			output += "-1";
+		} else {
+			put_fixed(ans.min);
+			output += ' ';
+			put_fixed(ans.avg);
+			output += ' ';
+			put_fixed(ans.max);
+		}
+		output += '\n';
+	}
+
+	void put(unsigned long long v) {
+		char digits[24];
+		int n = 0;
+		do digits[n++] = '0' + v % 10; while (v /= 10);
+		while (n) output += digits[--n];
+	}
+
+	/**
+	 * the same as printf("%.3f"); values that are too close to a tie for the fast rounding are left to printf
+	 */
+	void put_fixed(double v) {
+		double r = v * 1000;
+		long long q = std::llround(r);
+		if (std::fabs(r) < 1e9 && std::fabs(std::fabs(r - std::floor(r)) - 0.5) > 1e-6 && (q != 0 || v >= 0)) {
+			if (q < 0) output += '-';
+			unsigned long long u = q < 0 ? -q : q;
+			put(u / 1000);
+			output += '.';
+			output += char('0' + u / 100 % 10);
+			output += char('0' + u / 10 % 10);
+			output += char('0' + u % 10);
+		} else {
+			char s[64];
+			std::snprintf(s, sizeof(s), "%.3f", v);
+			output += s;
+		}
+	}
+
+	void flush(std::FILE* out) {
+		std::fwrite(output.data(), 1, output.size(), out);
+		std::fflush(out);
+		output.clear();
+	}
+
+private:
+	solver_type& solve;
+	unsigned char index[1024];
+	std::string output;
+};
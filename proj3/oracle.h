@@ -0,0 +1,208 @@
+#pragma once
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "solver.h"
+
+/**
+ * a TD n-tuple learner for threes on a small board, trained like TD_player of the 4x4 game
+ *
+ * a tuple is indexed by the tiles under it and the hint, and is summed over the images of the board by its reflections
+ * the network estimates the final score of an after state minus its current score (see score()),
+ * so that an after state is worth its score plus the estimate, and the best action leads to the most worthy after state
+ * the episodes are learned backward, like TD_player::update_episode()
+ */
+template<unsigned rows, unsigned cols, unsigned cap>
+class tuple_learner {
+public:
+	typedef small_board<rows, cols> board_type;
+
+	tuple_learner(const std::vector<std::vector<int>>& tuples, float alpha = 0.1, uint64_t seed = 0) : alpha(alpha), engine(seed) {
+		for (const std::vector<int>& p : tuples) {
+			feature f;
+			for (int i = 0; i < 4; i++) {
+				board_type idx;
+				for (unsigned t = 0; t < board_type::cells; t++) idx(t) = t;
+				if (i & 1) idx.reflect_horizontal();
+				if (i & 2) idx.reflect_vertical();
+				f.pattern[i].clear();
+				for (int t : p) f.pattern[i].push_back(idx(t));
+			}
+			size_t size = 3;
+			for (size_t k = 0; k < p.size(); k++) size *= cap;
+			f.weight.assign(size, 0);
+			net.push_back(f);
+		}
+	}
+
+	/**
+	 * the final score of a board, the same as the terminal value of the solver
+	 */
+	static float score(const board_type& board) {
+		float sum = 0;
+		for (unsigned i = 0; i < board_type::cells; i++)
+			if (board(i) >= 3) sum += std::pow(3, board(i) - 2);
+		return sum;
+	}
+
+	/**
+	 * the estimated final score of an after state, whose hint is the info of the board
+	 */
+	float worth(const board_type& board) const {
+		float value = score(board);
+		for (const feature& f : net)
+			for (int i = 0; i < 4; i++) value += f.weight[indexof(f.pattern[i], board)];
+		return value;
+	}
+
+	/**
+	 * the best action of a before state, whose hint is the info of the board, or -1 if there is none
+	 */
+	int best(const board_type& board) const {
+		int op = -1;
+		float value = 0;
+		for (int o = 0; o < 4; o++) {
+			board_type after = board;
+			if (after.slide(o) == -1) continue;
+			float v = worth(after);
+			if (op == -1 || v > value) {
+				op = o;
+				value = v;
+			}
+		}
+		return op;
+	}
+
+	/**
+	 * play a game by the best actions, learn from it, and return its final score
+	 * the tiles are drawn in the same way as the solver assumes: the hint is placed at a random empty cell
+	 * of the slide space, and the tiles are drawn at random from a bag of 1, 2 and 3, which is refilled when empty
+	 */
+	float train() {
+		std::vector<int> bag;
+		auto draw = [&]() {
+			if (bag.empty()) bag = { 1, 2, 3 };
+			size_t i = engine() % bag.size();
+			int tile = bag[i];
+			bag.erase(bag.begin() + i);
+			return tile;
+		};
+		board_type board;
+		board.place(engine() % board_type::cells, draw());
+		board.info(draw());
+		path.clear();
+		for (int op; (op = best(board)) != -1; ) {
+			board.slide(op);
+			path.push_back(board);
+			unsigned space[board_type::cells], n = 0;
+			for (unsigned k = 0; k < board_type::space_size(op); k++)
+				if (board(board_type::space(op, k)) == 0) space[n++] = board_type::space(op, k);
+			if (n == 0) break;
+			board.place(space[engine() % n], board.info());
+			board.info(draw());
+		}
+
+		float exact = score(board);
+		for (; path.size(); path.pop_back()) {
+			const board_type& after = path.back();
+			float error = exact - worth(after);
+			exact = update(after, alpha * error);
+		}
+		return score(board);
+	}
+
+private:
+	struct feature {
+		std::vector<int> pattern[4];
+		std::vector<float> weight;
+	};
+
+	static size_t indexof(const std::vector<int>& patt, const board_type& board) {
+		size_t index = 0;
+		for (int t : patt) index = index * cap + board(t);
+		return index * 3 + board.info() - 1;
+	}
+
+	/**
+	 * update an after state by u, and return its updated worth
+	 */
+	float update(const board_type& board, float u) {
+		float u_split = u / (net.size() * 4);
+		float value = score(board);
+		for (feature& f : net) {
+			for (int i = 0; i < 4; i++) {
+				float& w = f.weight[indexof(f.pattern[i], board)];
+				w += u_split;
+				value += w;
+			}
+		}
+		return value;
+	}
+
+private:
+	std::vector<feature> net;
+	float alpha;
+	std::mt19937_64 engine;
+	std::vector<board_type> path;
+};
+
+/**
+ * train a tuple_learner and measure it against the exact solver over all the reachable states, after doubling numbers of games
+ *
+ * the measures are
+ *  after error: the mean absolute (and root mean square) difference of the estimated and the exact expected final score of the after states
+ *  before error: the same for the before states, where the estimate is the worth of the best after state
+ *  regret: the mean loss of the expected final score by taking the best action of the learner instead of the optimal one,
+ *          and the ratio of the before states where the learner takes a suboptimal action
+ * the after states without any empty cell to place the hint are left out, they are never reached in a game
+ */
+template<unsigned rows, unsigned cols, unsigned cap>
+void oracle_benchmark(const basic_solver<rows, cols, cap>& solve, const std::vector<std::vector<int>>& tuples,
+		size_t games, float alpha, uint64_t seed, std::ostream& out) {
+	typedef typename basic_solver<rows, cols, cap>::answer answer;
+	typedef small_board<rows, cols> board_type;
+	tuple_learner<rows, cols, cap> learner(tuples, alpha, seed);
+
+	out << std::setw(9) << "games" << std::setw(10) << "games/s" << std::setw(10) << "score"
+	    << std::setw(12) << "after mae" << std::setw(12) << "after rmse" << std::setw(12) << "before mae"
+	    << std::setw(10) << "regret" << std::setw(12) << "suboptimal" << std::endl;
+	out << std::fixed;
+	double elapsed = 0;
+	for (size_t played = 0, next = std::min<size_t>(1000, games); played < games; next = std::min(next * 2, games)) {
+		double sum = 0;
+		size_t n = next - played;
+		auto start = std::chrono::steady_clock::now();
+		for (; played < next; played++) sum += learner.train();
+		elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		double after_abs = 0, after_sq = 0, before_abs = 0, regret = 0;
+		size_t afters = 0, befores = 0, suboptimal = 0;
+		solve.each_state([&](const board_type& board, int last_op, const answer& exact) {
+			if (std::isnan(exact.avg) || exact.avg < 0 || board == board_type()) return;
+			if (last_op >= 0) {
+				double error = learner.worth(board) - exact.avg;
+				after_abs += std::fabs(error);
+				after_sq += error * error;
+				afters++;
+				return;
+			}
+			int op = learner.best(board);
+			if (op == -1) return; // terminal, nothing to choose
+			board_type after = board;
+			after.slide(op);
+			answer chosen = solve.after_value(after, op);
+			before_abs += std::fabs(learner.worth(after) - exact.avg);
+			regret += exact.avg - chosen.avg;
+			suboptimal += (exact.avg - chosen.avg > 1e-6 * exact.avg);
+			befores++;
+		});
+		out << std::setw(9) << played << std::setw(10) << std::setprecision(0) << played / elapsed
+		    << std::setw(10) << std::setprecision(2) << sum / n
+		    << std::setw(12) << std::setprecision(3) << after_abs / afters << std::setw(12) << std::sqrt(after_sq / afters)
+		    << std::setw(12) << before_abs / befores << std::setw(10) << regret / befores
+		    << std::setw(11) << std::setprecision(2) << 100.0 * suboptimal / befores << "%" << std::endl;
+	}
+}
@@ -1,13 +1,22 @@
 #pragma once
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include "board2x3.h"
 #include <numeric>
-
-#define ROW 2
-#define COLUMN 3
-#define MAX_INDEX 10
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 class state_type {
 public:
@@ -63,11 +72,19 @@ private:
 };
 
 
-class solver {
+/**
+ * the exact solver of threes on a small board of the given rows and columns,
+ * where every tile is below the given cap (as an index, i.e., 10 means up to 384)
+ */
+template<unsigned rows, unsigned cols, unsigned cap>
+class basic_solver {
 public:
+	typedef small_board<rows, cols> board_type;
 	//typedef float value_t;
 	typedef double value_t;
 
+	static constexpr unsigned cells = board_type::cells;
+
 public:
 	class answer {
 	public:
@@ -83,33 +100,243 @@ public:
 		value_t min, avg, max;
 	};
 
+	/**
+	 * answer in 16 bytes instead of 24
+	 * min and max are always terminal values (float) or -1, so only avg needs a double
+	 */
+	class packed_answer {
+	public:
+		packed_answer() : min(0.0/0.0), max(0.0/0.0), avg(0.0/0.0) {}
+		packed_answer(const answer& ans) : min(ans.min), max(ans.max), avg(ans.avg) {}
+		operator answer() const { return answer(min, avg, max); }
+	public:
+		float min, max;
+		value_t avg;
+	};
+
+	/**
+	 * the counters of a solve, see summary()
+	 */
+	struct counters {
+		counters() : before(0), after(0), lookups(0), reflected(0), misses(0) {}
+		counters& operator +=(const counters& c){
+			before += c.before;
+			after += c.after;
+			lookups += c.lookups;
+			reflected += c.reflected;
+			misses += c.misses;
+			return *this;
+		}
+		uint64_t before, after; // the states solved
+		uint64_t lookups, reflected, misses; // the answers read, those of a reflected state, and those of an unstored state
+	};
+
+	/**
+	 * the table of answers, stored over the reachable states only and partitioned by level (see level_of)
+	 *
+	 * a state has a position in the full index space (see index_of), which grows as cap^(rows*cols),
+	 * so the reachable positions of each level are kept as a sorted array, and the answer of a state
+	 * is stored at the rank of its position in the array of its level, found by a binary search
+	 *
+	 * the table is either built in memory, or attached to the same layout in a table file:
+	 *  uint64 levels, uint64 count[levels], then for each level: uint64 positions[count], packed_answer values[count]
+	 *
+	 * for the boards whose tables do not fit in memory, a table can be built on disk instead (see spill_to):
+	 * each level is written to its own file of positions[count] and values[count], which is then mapped;
+	 * the retrograde order only needs a few adjacent levels at a time, so the others are released to the page cache
+	 */
 	class Transposition_Table
 	{
 	public:
-		Transposition_Table(bool type):type(type){
-			if(type) //before state
-				table = new answer[MAX_INDEX*MAX_INDEX*MAX_INDEX*MAX_INDEX*MAX_INDEX*MAX_INDEX*3];
-			else
-				table = new answer[MAX_INDEX*MAX_INDEX*MAX_INDEX*MAX_INDEX*MAX_INDEX*MAX_INDEX*3*4];
-		}
+		Transposition_Table(bool type):type(type), count(0){}
 		~Transposition_Table(){
-			delete []  table;
+			for(size_t at = 0; at < part.size(); ++at){
+				if(part[at].length) munmap(part[at].mapping, part[at].length);
+				if(spill.size()) std::remove(level_file(at).c_str());
+			}
 		}
 
-		answer& get_value(board2x3 board, int hint, int op, bool type){
-			int index = 0;
-			for(int i = 0; i < 6 ; ++i)
-				index = board(i) + (MAX_INDEX*index);
+		/**
+		 * build the levels assigned from now on in files under the given directory, which are removed with the table
+		 */
+		void spill_to(const std::string& dir){ spill = dir; }
+
+		size_t size() const { return count; }
+		size_t levels() const { return part.size(); }
+		size_t size(size_t at) const { return part[at].count; }
+		size_t bytes() const {
+			return sizeof(uint64_t) * (1 + part.size()) + (sizeof(uint64_t) + sizeof(packed_answer)) * count;
+		}
+
+		static uint64_t index_of(const board_type& board, int hint, int op, bool type){
+			uint64_t index = 0;
+			for(unsigned i = 0; i < cells ; ++i)
+				index = board(i) + (cap*index);
 
 			if(type)
-				return table[ hint-1 + index*3 ];
+				return hint-1 + index*3;
 			else
-				return table[ op + (hint-1 + index*3 )*4];
+				return op + (hint-1 + index*3 )*4;
+		}
+
+		/**
+		 * take the sorted positions of the reachable states of a level, and allocate their answers
+		 */
+		void assign(size_t at, std::vector<uint64_t>& keys){
+			if(part.size() <= at){
+				part.resize(at + 1);
+				own_keys.resize(at + 1);
+				own_values.resize(at + 1);
+			}
+			count -= part[at].count;
+			if(spill.size()){
+				map_level(at, keys);
+				std::vector<uint64_t>().swap(keys);
+				count += part[at].count;
+				return;
+			}
+			own_keys[at].swap(keys);
+			own_values[at].assign(own_keys[at].size(), packed_answer());
+			part[at].keys = own_keys[at].data();
+			part[at].values = own_values[at].data();
+			part[at].count = own_keys[at].size();
+			count += part[at].count;
+		}
+
+		/**
+		 * drop the pages of a level built on disk from memory, they are read back from the page cache or the file if needed
+		 */
+		void release(size_t at){
+			if(at < part.size() && part[at].length)
+				madvise(part[at].mapping, part[at].length, MADV_DONTNEED);
+		}
+
+		/**
+		 * the position of the k-th reachable state of a level, and its answer
+		 */
+		uint64_t key(size_t at, size_t k) const { return part[at].keys[k]; }
+		packed_answer& value(size_t at, size_t k){ return part[at].values[k]; }
+		const packed_answer& value(size_t at, size_t k) const { return part[at].values[k]; }
+
+		/**
+		 * the rank of a position in its level, or -1 if the position is unreachable
+		 */
+		size_t rank(size_t at, uint64_t index) const {
+			if(at >= part.size()) return -1;
+			const uint64_t* begin = part[at].keys;
+			const uint64_t* end = begin + part[at].count;
+			const uint64_t* it = std::lower_bound(begin, end, index);
+			return (it != end && *it == index) ? it - begin : size_t(-1);
+		}
+
+		packed_answer& get_value(const board_type& board, int hint, int op){
+			size_t at = level_of(board);
+			return part[at].values[rank(at, index_of(board, hint, op, type))];
+		}
+
+		/**
+		 * the stored answer of a state, or nullptr if the state is unreachable
+		 */
+		const packed_answer* lookup(const board_type& board, int hint, int op) const {
+			size_t at = level_of(board);
+			size_t r = rank(at, index_of(board, hint, op, type));
+			return r != size_t(-1) ? part[at].values + r : nullptr;
+		}
+
+		/**
+		 * look up a state, an unreachable state gives a NaN answer
+		 */
+		answer find(const board_type& board, int hint, int op) const {
+			const packed_answer* value = lookup(board, hint, op);
+			return value ? answer(*value) : answer();
+		}
+
+		void save(std::ostream& out) const {
+			uint64_t n = part.size();
+			out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+			for(const span& s : part){
+				uint64_t c = s.count;
+				out.write(reinterpret_cast<const char*>(&c), sizeof(c));
+			}
+			for(const span& s : part){
+				out.write(reinterpret_cast<const char*>(s.keys), sizeof(uint64_t) * s.count);
+				out.write(reinterpret_cast<const char*>(s.values), sizeof(packed_answer) * s.count);
+			}
+		}
+
+		/**
+		 * attach to the layout at p, and return the end of it, or nullptr if it does not fit before end
+		 */
+		const char* attach(const char* p, const char* end){
+			uint64_t n;
+			if(size_t(end - p) < sizeof(n)) return nullptr;
+			std::memcpy(&n, p, sizeof(n));
+			p += sizeof(n);
+			if(size_t(end - p) / sizeof(uint64_t) < n) return nullptr;
+			std::vector<span> parts(n);
+			const char* q = p + sizeof(uint64_t) * n;
+			size_t total = 0;
+			for(size_t at = 0; at < n; ++at){
+				uint64_t c;
+				std::memcpy(&c, p + sizeof(uint64_t) * at, sizeof(c));
+				if(size_t(end - q) / (sizeof(uint64_t) + sizeof(packed_answer)) < c) return nullptr;
+				parts[at].keys = reinterpret_cast<const uint64_t*>(q);
+				parts[at].values = reinterpret_cast<packed_answer*>(const_cast<char*>(q + sizeof(uint64_t) * c));
+				parts[at].count = c;
+				q += (sizeof(uint64_t) + sizeof(packed_answer)) * c;
+				total += c;
+			}
+			part.swap(parts);
+			count = total;
+			return q;
 		}
 
 	private:
-		answer *table;
-		bool type;	
+		std::string level_file(size_t at) const {
+			return spill + (type ? "/before." : "/after.") + std::to_string(at);
+		}
+
+		/**
+		 * write a level to its file, with unsolved answers, and map it
+		 */
+		void map_level(size_t at, const std::vector<uint64_t>& keys){
+			const std::string path = level_file(at);
+			std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+			out.write(reinterpret_cast<const char*>(keys.data()), sizeof(uint64_t) * keys.size());
+			const std::vector<packed_answer> unsolved(std::min<size_t>(keys.size(), 65536));
+			for(size_t n = 0; n < keys.size(); n += unsolved.size())
+				out.write(reinterpret_cast<const char*>(unsolved.data()), sizeof(packed_answer) * std::min(unsolved.size(), keys.size() - n));
+			out.close();
+			part[at].count = keys.size();
+			if(keys.empty()) return;
+			const size_t length = (sizeof(uint64_t) + sizeof(packed_answer)) * keys.size();
+			int fd = out.good() ? open(path.c_str(), O_RDWR) : -1;
+			void* p = fd >= 0 ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+			if(fd >= 0) close(fd);
+			if(p == MAP_FAILED){
+				std::cerr << "cannot build the level " << at << " in " << path << std::endl;
+				std::exit(1);
+			}
+			part[at].mapping = p;
+			part[at].length = length;
+			part[at].keys = static_cast<const uint64_t*>(p);
+			part[at].values = reinterpret_cast<packed_answer*>(static_cast<char*>(p) + sizeof(uint64_t) * keys.size());
+		}
+
+		struct span {
+			span() : keys(nullptr), values(nullptr), count(0), mapping(nullptr), length(0) {}
+			const uint64_t* keys;
+			packed_answer* values; // read-only if attached
+			size_t count;
+			void* mapping; // the file of the level, if built on disk
+			size_t length;
+		};
+		bool type;
+		std::vector<span> part;
+		size_t count;
+		std::string spill;
+		std::vector<std::vector<uint64_t>> own_keys;
+		std::vector<std::vector<packed_answer>> own_values;
 	};
 
 	class tile_bag{
@@ -144,12 +371,170 @@ public:
 	};
 
 private:
+	static constexpr uint64_t power(uint64_t base, unsigned exp){ return exp ? base * power(base, exp - 1) : 1; }
+	static_assert(power(cap, cells) <= uint64_t(-1) / 12, "the index space does not fit in 64 bits");
+
+	/**
+	 * reduce a state to its canonical form under the reflections of the board, i.e., its image with the smallest index
+	 * a left-right reflection swaps right (1) and left (3), an up-down reflection swaps up (0) and down (2),
+	 * so that the last action (and hence the slide space) of an after state follows the board
+	 * symmetric states have the same answer, so only the canonical ones are stored
+	 * return whether the state is changed
+	 */
+	static bool canonicalize(board_type& board, int& op, bool type){
+		board_type best = board;
+		int best_op = op;
+		bool changed = false;
+		uint64_t best_index = Transposition_Table::index_of(board, 1, op, type);
+		for(int i = 1; i < 4; ++i){
+			board_type b = board;
+			int o = op;
+			if(i & 1){ b.reflect_horizontal(); if(o % 2 == 1) o ^= 2; }
+			if(i & 2){ b.reflect_vertical();   if(o % 2 == 0) o ^= 2; }
+			uint64_t index = Transposition_Table::index_of(b, 1, o, type);
+			if(index < best_index){
+				best = b;
+				best_op = o;
+				best_index = index;
+				changed = true;
+			}
+		}
+		board = best;
+		op = best_op;
+		return changed;
+	}
+
+	/**
+	 * the sum of the tile values on a board, which is the level of a state in the retrograde order:
+	 * a slide keeps the sum, and placing a tile increases it, so every successor of an after state
+	 * is at a higher level, and every successor of a before state is an after state at the same level
+	 */
+	static int level_of(const board_type& board){
+		int sum = 0;
+		for(unsigned i = 0; i < cells; ++i){
+			int tile = board(i);
+			sum += tile <= 3 ? tile : 3 << (tile - 3);
+		}
+		return sum;
+	}
 
-	float calculate_expect(board2x3 board){
+	/**
+	 * the bag of an after state at the given level, before its hint is taken
+	 * every full bag adds 1 + 2 + 3 = 6 to the level, so level % 6 is the sum of the tiles taken from the current bag;
+	 * a sum of 3 is either {3} or {1, 2}, and the hint tells them apart since it is still in the bag
+	 */
+	static tile_bag bag_of(int level, int hint){
+		tile_bag bag;
+		switch(level % 6){
+			case 1: bag.set(0); break;
+			case 2: bag.set(1); break;
+			case 3: if(hint == 3) { bag.set(0); bag.set(1); } else bag.set(2); break;
+			case 4: bag.set(0); bag.set(2); break;
+			case 5: bag.set(1); bag.set(2); break;
+		}
+		return bag;
+	}
+
+	static board_type board_of(uint64_t index, bool type){
+		index = type ? index / 3 : index / 12;
+		board_type board;
+		for(int i = cells - 1; i >= 0; --i, index /= cap)
+			board(i) = index % cap;
+		return board;
+	}
+
+	/**
+	 * the positions of the states of a level gathered so far, with duplicates up to about twice the distinct ones
+	 */
+	struct gather {
+		gather() : distinct(0) {}
+		void push(uint64_t index){
+			keys.push_back(index);
+			if(keys.size() >= 2 * distinct + 4096) compact();
+		}
+		void compact(){
+			std::sort(keys.begin(), keys.end());
+			keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+			distinct = keys.size();
+		}
+		std::vector<uint64_t> keys;
+		size_t distinct;
+	};
+
+	/**
+	 * enumeration pass: collect the reachable canonical states into the tables, by ascending level
+	 * the before states of a level lead to the after states of the same level, which lead to the before states
+	 * of higher levels, so all the states of a level are known when it is reached
+	 */
+	void enumerate(){
+		std::vector<gather> before(1);
+		auto add_before = [&](board_type board, int hint){
+			int op = 0;
+			canonicalize(board, op, true);
+			size_t at = level_of(board);
+			if(before.size() <= at) before.resize(at + 1);
+			before[at].push(Transposition_Table::index_of(board, hint, 0, true));
+		};
+
+		for(unsigned pos = 0; pos < cells ; ++pos){
+			for(int tile = 1; tile <4 ; ++tile){
+				board_type board;
+				board.place(pos, tile);
+				for(int h = 1; h <4 ;++h){
+					if(h != tile) add_before(board, h);
+				}
+			}
+		}
+		for(size_t at = 0; at < before.size(); ++at){
+			gather after;
+			before[at].compact();
+			for(uint64_t index : before[at].keys){
+				board_type board = board_of(index, true);
+				for(int op: {0, 1, 2, 3}){
+					board_type b = board;
+					if(b.slide(op) == -1) continue;
+					for(unsigned i = 0; i < cells; ++i){
+						if(b(i) < cap) continue;
+						std::cerr << "the tiles of " << rows << "x" << cols << " exceed the cap " << cap << std::endl;
+						std::exit(1);
+					}
+					int last_op = op;
+					canonicalize(b, last_op, false);
+					after.push(Transposition_Table::index_of(b, index % 3 + 1, last_op, false));
+				}
+			}
+			after.compact();
+			for(uint64_t index : after.keys){
+				board_type board = board_of(index, false);
+				int hint = index / 4 % 3 + 1, last_op = index % 4;
+				tile_bag bag = bag_of(at, hint);
+				bag.set(hint-1);
+				for(unsigned k = 0; k < board_type::space_size(last_op) ;++k){
+					unsigned pos = board_type::space(last_op, k);
+					if(board(pos)!=0) continue;
+					for(int new_hint: {1, 2, 3}){
+						if(bag.get(new_hint-1)) continue;
+						board_type b = board;
+						b.place(pos, hint);
+						add_before(b, new_hint);
+					}
+				}
+			}
+			if(at == 0){
+				for(int i = 1 ; i < 4 ; ++i) // the empty board is canonical with up (0), see compute()
+					after.keys.push_back(Transposition_Table::index_of(board_type(), i, 0, false));
+				after.compact();
+			}
+			before_state.assign(at, before[at].keys);
+			after_state.assign(at, after.keys);
+		}
+	}
+
+	float calculate_expect(const board_type& board){
 
 		float sum = 0;
 		int tile = 0;
-		for(int i= 0; i < 6 ; ++i){	
+		for(unsigned i= 0; i < cells ; ++i){
 			tile = board(i);			
 			if(tile >= 3){
 				//std::cout << "tile: " << tile << std::endl;
@@ -160,11 +545,37 @@ private:
 		return sum;
 	}
 
-	//void get_before_expect(board2x3 board, int hint){
-	answer get_before_expect(board2x3 board, int hint){
+	/**
+	 * the solved answer of any state, in any orientation
+	 */
+	answer get_before_expect(board_type board, int hint, counters& count){
+		int op = 0;
+		++count.lookups;
+		if(canonicalize(board, op, true)) ++count.reflected;
+		return found(before_state.lookup(board, hint, 0), count);
+	}
+
+	answer get_after_expect(board_type board, int hint, int last_op, counters& count){
+		++count.lookups;
+		if(canonicalize(board, last_op, false)) ++count.reflected;
+		return found(after_state.lookup(board, hint, last_op), count);
+	}
+
+	static answer found(const packed_answer* value, counters& count){
+		if(value) return *value;
+		++count.misses;
+		return answer();
+	}
 
-		answer& expect = before_state.get_value(board, hint, 0, true);
-		if(!std::isnan(expect.avg)) return expect;
+	/**
+	 * solve the k-th before state of a level, whose after states have been solved
+	 */
+	void solve_before(size_t at, size_t k, counters& count){
+		++count.before;
+		uint64_t index = before_state.key(at, k);
+		board_type board = board_of(index, true);
+		int hint = index % 3 + 1;
+		packed_answer& expect = before_state.value(at, k);
 
 		answer tmp;
 		answer ans; //initalize tmp ans
@@ -173,65 +584,49 @@ private:
 		bool terminal = true;
 
 		for(int op: {0, 1, 2, 3}){ //up right down left
-			board2x3 b = board;
+			board_type b = board;
 			int reward = b.slide(op);
 
 			if(reward != -1){
 				terminal = false;				
-				tmp = get_after_expect(b, hint, op);
+				tmp = get_after_expect(b, hint, op, count);
 				if(!std::isnan(tmp.avg) && tmp.avg > ans.avg)//optimal action based on the average value
 					ans = tmp;
 			}
 		}
 
-
 		if(terminal){
-			//std::cout << "terminal node\n";
 			float temp_expect = calculate_expect(board);
 			expect = answer(temp_expect, temp_expect, temp_expect);
-			//std::cout << "value: " << expect <<std::endl;
 		}
 
 		else
 			expect = ans.avg==-1 ? answer() : ans;
-		//std::cout << "BEFORE STATE RETURN >" << std::endl;
-		//std::cout << board;
-		//std::cout << "hint: " << hint << std::endl;
-		//std::cout << "answer: " << expect <<std::endl << std::endl;
-		return expect;
 	}
 
-	//void get_after_expect(board2x3 board, int hint, int last_op){
-	answer get_after_expect(board2x3 board, int hint, int last_op){
-	    answer& expect = after_state.get_value(board, hint, last_op, false);
-	    if(!std::isnan(expect.avg)) return expect;;
-
-		//according to the last action decide where can put the tile
-		const int size = last_op % 2 == 0 ? 3 : 2;
-		std::array<int,3> slide_space;
-		switch (last_op) {
-			case 0: slide_space = {3, 4, 5}; //slide up 0
-				break;
-			case 1: slide_space = {0, 3}; //slide right 1
-				break;
-			case 2: slide_space = {0, 1, 2}; //slide down 2
-				break;
-			case 3: slide_space = {2, 5}; //slide left 3
-				break;
-			default:
-				std::cout << "no such action! " << (last_op & 0b11)<< "\n";
-		}				
+	/**
+	 * solve the k-th after state of a level, whose successors (at higher levels) have been solved
+	 */
+	void solve_after(size_t at, size_t k, counters& count){
+		++count.after;
+		uint64_t index = after_state.key(at, k);
+		board_type board = board_of(index, false);
+		int hint = index / 4 % 3 + 1, last_op = index % 4;
+		packed_answer& expect = after_state.value(at, k);
 
 		value_t sum = 0.0;
-		int count  = 0;
+		int n = 0;
 		answer tmp;
 		answer ans;
 		bool valid = false;
 
+		tile_bag bag = bag_of(at, hint);
 		bag.set(hint-1);//set hint tile to be used
-		for(int i = 0; i < size ;++i){//place the hint tile
+		//according to the last action decide where can put the tile
+		for(unsigned i = 0; i < board_type::space_size(last_op) ;++i){//place the hint tile
+			unsigned pos = board_type::space(last_op, i);
 
-			if(board(slide_space[i])!=0) continue;
+			if(board(pos)!=0) continue;
 
 			else{ //only calculate those are possible
 				valid = true;
@@ -239,11 +634,11 @@ private:
 					if(bag.get(new_hint-1)) continue;
 
 					else { //grab new tile
-						board2x3 b = board;
-						b.place(slide_space[i], hint);
-						tmp = get_before_expect(b, new_hint);
+						board_type b = board;
+						b.place(pos, hint);
+						tmp = get_before_expect(b, new_hint, count);
 						if(!std::isnan(tmp.avg)){
-							if(count==0){
+							if(n==0){
 								ans = tmp;
 								sum = tmp.avg;
 							}
@@ -252,29 +647,173 @@ private:
 								ans.min = tmp.min < ans.min ? tmp.min : ans.min;
 								sum += tmp.avg;
 							}						
-							++count;
+							++n;
 						}
 					}
 						
 				} 
 			}
 		}
-		bag.unset(hint-1);
 
-		if(count>0)
-			expect = answer(ans.min, sum/count, ans.max);
+		if(n>0)
+			expect = answer(ans.min, sum/n, ans.max);
 		if(!valid)
 			expect = answer(-1, -1, -1);
-		//std::cout << "AFTER STATE RETURN >" << std::endl;
-		//std::cout << board;
-		//std::cout << "hint: " << hint << "last op: " << last_op << std::endl;
-		//std::cout << after_state.get_value(board, hint, last_op, false) << std::endl;
-		//std::cout << "answer: " << expect <<std::endl << std::endl;
-		return expect;
 	}
 
+	/**
+	 * the magic of a table file, followed by the rows, the columns and the cap as uint64, see load()
+	 */
+	static const char* magic(){ return "tsmall01"; }
+
 public:
-	solver():before_state(true), after_state(false){
+	/**
+	 * attach the tables to a table file written by save(), by mmap
+	 * return false if the file is absent or not a table file of this board
+	 *
+	 * the file is
+	 *  char magic[8] = "tsmall01", uint64 rows, cols, cap, the before table, the after table
+	 */
+	bool load(const std::string& path){
+		int fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0) return false;
+		struct stat st;
+		const uint64_t shape[3] = { rows, cols, cap };
+		void* p = (fstat(fd, &st) == 0 && size_t(st.st_size) > 8 + sizeof(shape)) ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		close(fd);
+		if(p == MAP_FAILED) return false;
+		const char* begin = static_cast<const char*>(p);
+		const char* end = begin + st.st_size;
+		const char* q = nullptr;
+		if(std::memcmp(begin, magic(), 8) == 0 && std::memcmp(begin + 8, shape, sizeof(shape)) == 0)
+			q = before_state.attach(begin + 8 + sizeof(shape), end);
+		if(q) q = after_state.attach(q, end);
+		if(!q){
+			munmap(p, st.st_size);
+			return false;
+		}
+		mapped = p;
+		mapped_size = st.st_size;
+		return true;
+	}
+
+	/**
+	 * save the computed tables to a table file, see load()
+	 */
+	void save(std::ostream& out) const {
+		const uint64_t shape[3] = { rows, cols, cap };
+		out.write(magic(), 8);
+		out.write(reinterpret_cast<const char*>(shape), sizeof(shape));
+		before_state.save(out);
+		after_state.save(out);
+	}
+	void save(const std::string& path) const {
+		std::ofstream out(path + ".tmp", std::ios::out | std::ios::binary | std::ios::trunc);
+		save(out);
+		out.close();
+		if(out.good()) std::rename((path + ".tmp").c_str(), path.c_str());
+	}
+
+	/**
+	 * the size of the tables: the number of stored states and levels, and the bytes of a table file
+	 */
+	size_t states() const { return before_state.size() + after_state.size(); }
+	size_t levels() const { return after_state.levels(); }
+	size_t bytes() const { return 8 + 3 * sizeof(uint64_t) + before_state.bytes() + after_state.bytes(); }
+
+private:
+	/**
+	 * a reusable barrier for a fixed number of threads
+	 */
+	class barrier {
+	public:
+		barrier(unsigned n) : n(n), waiting(0), generation(0) {}
+		/**
+		 * return true in the last thread to arrive
+		 */
+		bool wait(){
+			std::unique_lock<std::mutex> lock(mutex);
+			unsigned gen = generation;
+			if(++waiting == n){
+				waiting = 0;
+				++generation;
+				cv.notify_all();
+				return true;
+			}
+			cv.wait(lock, [&]{ return gen != generation; });
+			return false;
+		}
+	private:
+		std::mutex mutex;
+		std::condition_variable cv;
+		unsigned n, waiting, generation;
+	};
+
+	/**
+	 * solve the enumerated levels from the highest down, solving the after states of a level before its before states
+	 * level 0 holds only the after states of the empty board, which are set by compute()
+	 *
+	 * the states of one phase (the after or the before states of a level) only read answers of earlier phases,
+	 * so the threads share each phase in chunks taken from an atomic cursor, and wait at a barrier between phases;
+	 * every answer is computed by the same code from the same inputs, so the tables do not depend on the threads
+	 *
+	 * a placed tile raises the level by 3 at most, so once a level is solved, the states 3 levels above it
+	 * are never read again, and their pages are released if the tables are on disk
+	 */
+	void solve_levels(unsigned threads){
+		const size_t levels = after_state.levels(), phases = levels * 2, chunk = 256;
+		if(threads <= 1){
+			for(size_t at = levels; at-- > 1; ){
+				for(size_t k = 0; k < after_state.size(at); ++k) solve_after(at, k, stats);
+				for(size_t k = 0; k < before_state.size(at); ++k) solve_before(at, k, stats);
+				release(at + 3);
+			}
+			return;
+		}
+
+		std::unique_ptr<std::atomic<size_t>[]> cursor(new std::atomic<size_t>[phases]);
+		for(size_t i = 0; i < phases; ++i) cursor[i] = 0;
+		barrier sync(threads);
+		std::mutex merge;
+
+		auto work = [&](){
+			counters local; // merged at the end, not to share the counters between the threads
+			for(size_t at = levels; at-- > 1; ){
+				const size_t after = after_state.size(at);
+				for(size_t i; (i = cursor[at * 2].fetch_add(chunk)) < after; ){
+					for(size_t k = i; k < std::min(i + chunk, after); ++k) solve_after(at, k, local);
+				}
+				sync.wait();
+				const size_t before = before_state.size(at);
+				for(size_t i; (i = cursor[at * 2 + 1].fetch_add(chunk)) < before; ){
+					for(size_t k = i; k < std::min(i + chunk, before); ++k) solve_before(at, k, local);
+				}
+				if(sync.wait()) release(at + 3);
+			}
+			std::lock_guard<std::mutex> lock(merge);
+			stats += local;
+		};
+
+		std::vector<std::thread> pool;
+		for(unsigned t = 1; t < threads; ++t) pool.emplace_back(work);
+		work();
+		for(std::thread& t : pool) t.join();
+	}
+
+	void release(size_t at){
+		before_state.release(at);
+		after_state.release(at);
+	}
+
+	/**
+	 * retrograde analysis: enumerate the reachable states by level, then solve them level by level
+	 */
+	void compute(unsigned threads){
+		auto start = std::chrono::steady_clock::now();
+		enumerate();
+		lap("enumerate", start);
+		solve_levels(threads);
+		lap("solve", start);
 
 		answer expect;
 		value_t sum = 0.0;
@@ -282,18 +821,17 @@ public:
 		answer tmp;
 		answer ans;
 
-		for(int pos = 0; pos < ROW*COLUMN ; ++pos){
+		for(unsigned pos = 0; pos < cells ; ++pos){
 			for(int tile = 1; tile <4 ; ++tile){
-				board2x3 board;
+				board_type board;
 				board.place(pos, tile);
-				bag.set(tile-1);
 				for(int h = 1; h <4 ;++h){
 
 					if(h==tile) continue;
 
 					else{
 						
-						tmp = get_before_expect(board, h);
+						tmp = get_before_expect(board, h, stats);
 
 						if(!std::isnan(tmp.avg)){
 							if(count==0){
@@ -311,49 +849,91 @@ public:
 
 
 				}
-				bag.unset(tile-1);				
 			}
 		}
 
 		if(count>0)
 			expect = answer(ans.min, sum/count, ans.max);
 
-		board2x3 board;
+		board_type board;
 		for(int i = 1 ; i < 4 ; ++i){
-			answer& result = after_state.get_value(board, i, 0, false);
+			packed_answer& result = after_state.get_value(board, i, 0);
 			result = expect;	
 		}
+		lap("root", start);
+	}
+
+	/**
+	 * record the time of a phase since start, and restart it
+	 */
+	void lap(const std::string& phase, std::chrono::steady_clock::time_point& start){
+		auto now = std::chrono::steady_clock::now();
+		phases.emplace_back(phase, std::chrono::duration<double>(now - start).count());
+		start = now;
+	}
+
+public:
+	/**
+	 * solve the game with the given number of threads, or load the answers from a table file if given
+	 * the table file is created after solving if it does not exist yet
+	 * the tables are built in files under the spill directory if given, see Transposition_Table
+	 */
+	basic_solver(const std::string& table = "", unsigned threads = 1, const std::string& spill = "")
+		:before_state(true), after_state(false), mapped(nullptr), mapped_size(0), threads(threads){
+		auto start = std::chrono::steady_clock::now();
+		if(table.size() && load(table)){
+			lap("load", start);
+		} else {
+			before_state.spill_to(spill);
+			after_state.spill_to(spill);
+			compute(threads);
+			start = std::chrono::steady_clock::now();
+			if(table.size()){
+				save(table);
+				lap("save", start);
+			}
+		}
 
 		std::cout << "solver is initialized." << std::endl;
 
 	}
+	~basic_solver(){
+		if(mapped) munmap(mapped, mapped_size);
+	}
 
-	answer solve(const board2x3& board, state_type type = state_type::before) {
+	answer solve(const board_type& board, state_type type = state_type::before) {
 		// TODO: find the answer in the lookup table and return it
 		//       do NOT recalculate the tree at here
 
 		// to fetch the hint (if type == state_type::after, hint will be 0)
-		board2x3::cell hint = state_hint(board);
+		int hint = board.info();
 
 		// for a legal state, return its three values.
 //		return { min, avg, max };
 		answer invalid;
 		//check if it is illegal board
 		int tile;
-		for(int i = 0; i < 2*3; ++i){
+		for(unsigned i = 0; i < cells; ++i){
 			tile = board(i);
-			if(tile >= MAX_INDEX || tile < 0){
+			if(tile >= int(cap) || tile < 0){
 				std::cout << " illegal board\n";
 				return invalid;
 			}
 		}
 
-		if(type.is_before())
-			return before_state.get_value(board, hint, 0, true);
+		if(type.is_before()){
+			board_type key = board;
+			int op = 0;
+			canonicalize(key, op, true);
+			return before_state.find(key, hint, 0);
+		}
 
 		else{
 			for(int i = 0 ;i < 4; ++i){ //valid answer according to last action
-				answer& ans = after_state.get_value(board, hint, i, false);
+				board_type key = board;
+				int op = i;
+				canonicalize(key, op, false);
+				answer ans = after_state.find(key, hint, op);
 				if(!std::isnan(ans.avg))
 					return ans;
 			}
@@ -363,10 +943,82 @@ public:
 	}
 
 
+	/**
+	 * the answer of an after state by the given last action, whose hint is the info of the board
+	 * unlike solve(), which takes any action that gives a stored state, the slide space of the action is kept
+	 */
+	answer after_value(const board_type& board, int last_op) const {
+		board_type key = board;
+		canonicalize(key, last_op, false);
+		return after_state.find(key, board.info(), last_op);
+	}
+
+	/**
+	 * visit every stored state by visit(board, last_op, answer), where the hint is the info of the board,
+	 * the before states first (with last_op -1), then the after states
+	 */
+	template<class visit>
+	void each_state(visit f) const {
+		for(bool type : {true, false}){
+			const Transposition_Table& table = type ? before_state : after_state;
+			for(size_t at = 0; at < table.levels(); ++at){
+				for(size_t k = 0; k < table.size(at); ++k){
+					uint64_t index = table.key(at, k);
+					board_type board = board_of(index, type);
+					board.info(type ? index % 3 + 1 : index / 4 % 3 + 1);
+					f(board, type ? -1 : int(index % 4), answer(table.value(at, k)));
+				}
+			}
+		}
+	}
+
+	/**
+	 * print the counters, the time of each phase, and the number of states of each level,
+	 * either for reading or as a JSON object
+	 */
+	void summary(std::ostream& out, bool json = false) const {
+		if(json){
+			out << "{\"rows\":" << rows << ",\"cols\":" << cols << ",\"cap\":" << cap << ",\"threads\":" << threads
+			    << ",\"states\":" << states() << ",\"bytes\":" << bytes()
+			    << ",\"solved\":{\"before\":" << stats.before << ",\"after\":" << stats.after << "}"
+			    << ",\"lookups\":{\"total\":" << stats.lookups << ",\"reflected\":" << stats.reflected << ",\"misses\":" << stats.misses << "}"
+			    << ",\"phases\":{";
+			for(size_t i = 0; i < phases.size(); ++i)
+				out << (i ? "," : "") << "\"" << phases[i].first << "\":" << phases[i].second;
+			out << "},\"levels\":[";
+			for(size_t at = 0, n = 0; at < levels(); ++at){
+				if(!before_state.size(at) && !after_state.size(at)) continue;
+				out << (n++ ? "," : "") << "[" << at << "," << before_state.size(at) << "," << after_state.size(at) << "]";
+			}
+			out << "]}" << std::endl;
+			return;
+		}
+		out << rows << "x" << cols << " solver: " << states() << " states in " << levels() << " levels, "
+		    << bytes() << " bytes, " << threads << " thread(s)" << std::endl;
+		out << "solved: " << stats.before << " before states, " << stats.after << " after states" << std::endl;
+		out << "lookups: " << stats.lookups << ", " << stats.reflected << " reflected ("
+		    << (stats.lookups ? 100.0 * stats.reflected / stats.lookups : 0.0) << "%), " << stats.misses << " unstored" << std::endl;
+		out << "phases:";
+		for(const auto& phase : phases) out << " " << phase.first << " " << phase.second * 1000 << " ms";
+		out << std::endl;
+		out << "level before after" << std::endl;
+		for(size_t at = 0; at < levels(); ++at){
+			if(!before_state.size(at) && !after_state.size(at)) continue;
+			out << std::setw(5) << at << std::setw(7) << before_state.size(at) << std::setw(6) << after_state.size(at) << std::endl;
+		}
+	}
+
 private:
 	Transposition_Table before_state;
 	Transposition_Table after_state;
-	tile_bag bag;
+	void* mapped;
+	size_t mapped_size;
+	unsigned threads;
+	counters stats;
+	std::vector<std::pair<std::string, double>> phases;
 };
 
+template<unsigned rows, unsigned cols, unsigned cap>
+constexpr unsigned basic_solver<rows, cols, cap>::cells;
 
+typedef basic_solver<2, 3, 10> solver;
@@ -10,12 +10,113 @@
 #include <fstream>
 #include <iterator>
 #include <string>
+#include <sstream>
+#include <chrono>
 #include "board2x3.h"
 #include "solver.h"
+#include "batch.h"
+#include "oracle.h"
+
+/**
+ * print the counters of a solver, or append them as a JSON line to a file
+ */
+template<class solver_type>
+void summarize(const solver_type& solve, const std::string& stats) {
+	if (stats == "-") {
+		solve.summary(std::cout);
+	} else {
+		std::ofstream out(stats, std::ios::out | std::ios::app);
+		solve.summary(out, true);
+	}
+}
+
+/**
+ * solve the game on another board, and print the size of its tables and the time to solve it
+ */
+template<unsigned rows, unsigned cols, unsigned cap>
+void report(unsigned threads, const std::string& spill, const std::string& stats) {
+	auto start = std::chrono::steady_clock::now();
+	basic_solver<rows, cols, cap> solve("", threads, spill);
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << rows << "x" << cols << " (cap " << cap << "): " << solve.states() << " states in "
+	          << solve.levels() << " levels, " << solve.bytes() << " bytes, " << elapsed * 1000 << " ms" << std::endl;
+	if (stats.size()) summarize(solve, stats);
+}
 
 int main(int argc, const char* argv[]) {
+	std::string table, spill, batch, stats;
+	unsigned threads = 1;
+	size_t oracle = 0;
+	float alpha = 0.1;
+	uint64_t seed = 0;
+	bool speedup = false, variants = false;
+	for (int i = 1; i < argc; i++) {
+		std::string para(argv[i]);
+		if (para.find("--table=") == 0) { // load the answers from a table file, or create it
+			table = para.substr(para.find("=") + 1);
+		} else if (para.find("--spill=") == 0) { // build the tables in files under a directory, for the boards beyond memory
+			spill = para.substr(para.find("=") + 1);
+		} else if (para.find("--threads=") == 0) { // solve with multiple threads
+			threads = std::stoul(para.substr(para.find("=") + 1));
+		} else if (para.find("--speedup") == 0) { // compare the solve with 1 and --threads threads, then exit
+			speedup = true;
+		} else if (para.find("--variants") == 0) { // solve the game on other boards, then exit
+			variants = true;
+		} else if (para.find("--stats") == 0) { // print the counters of the solver, or --stats=FILE to dump them as JSON
+			stats = para.find("=") != std::string::npos ? para.substr(para.find("=") + 1) : "-";
+		} else if (para.find("--oracle=") == 0) { // train a tuple network by the given games, measured against the solver
+			oracle = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--alpha=") == 0) { // the learning rate of --oracle
+			alpha = std::stof(para.substr(para.find("=") + 1));
+		} else if (para.find("--seed=") == 0) { // the seed of --oracle
+			seed = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--batch") == 0) { // answer the queries in batch, --batch=binary for the binary format
+			batch = para.find("=") != std::string::npos ? para.substr(para.find("=") + 1) : "text";
+		}
+	}
+	if (batch == "binary") std::cout.rdbuf(std::cerr.rdbuf()); // keep the output for the responses only
 	std::cout << "threes2x3-Demo: " << std::endl;
-	solver solve;
+
+	if (speedup) {
+		std::stringstream tables[2];
+		double elapsed[2];
+		unsigned count[2] = { 1, threads };
+		for (int k = 0; k < 2; k++) {
+			auto start = std::chrono::steady_clock::now();
+			solver solve("", count[k]);
+			elapsed[k] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			solve.save(tables[k]);
+			std::cout << count[k] << " thread(s): " << elapsed[k] * 1000 << " ms" << std::endl;
+		}
+		std::cout << "speedup = " << elapsed[0] / elapsed[1] << ", tables are "
+		          << (tables[0].str() == tables[1].str() ? "identical" : "DIFFERENT") << std::endl;
+		return 0;
+	}
+
+	if (variants) {
+		report<2, 2, 10>(threads, spill, stats);
+		report<2, 3, 10>(threads, spill, stats);
+		report<2, 4, 14>(threads, spill, stats);
+		if (spill.size()) report<3, 3, 16>(threads, spill, stats); // about 13 GB of tables
+		return 0;
+	}
+
+	solver solve(table, threads, spill);
+	if (stats.size()) summarize(solve, stats);
+	if (oracle) {
+		// a row, the side and middle columns, and a square, each with its images by reflections
+		oracle_benchmark(solve, { { 0, 1, 2 }, { 0, 3 }, { 1, 4 }, { 0, 1, 3, 4 } }, oracle, alpha, seed, std::cout);
+		return 0;
+	}
+	if (batch.size()) {
+		query_batch<2, 3, 10> serve(solve);
+		auto start = std::chrono::steady_clock::now();
+		size_t count = batch == "binary" ? serve.binary(stdin, stdout) : serve.text(stdin, stdout);
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cerr << count << " queries in " << elapsed * 1000 << " ms" << std::endl;
+		return 0;
+	}
+
 	board2x3 state;
 	state_type type;
 	state_hint hint(state);
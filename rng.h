@@ -0,0 +1,98 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+
+/**
+ * Philox4x32-10 counter-based random function (Salmon et al., SC'11)
+ * maps a 128-bit counter and a 64-bit key to 128 random bits, with no state,
+ * so any block of any stream can be computed directly from its coordinates
+ *
+ * see https://www.deshawresearch.com/resources_random123.html
+ */
+class philox {
+public:
+	typedef std::array<uint32_t, 4> counter;
+	typedef std::array<uint32_t, 2> key;
+
+	static counter block(counter ctr, key k) {
+		for (int r = 0; r < 10; r++) {
+			if (r) k[0] += 0x9e3779b9, k[1] += 0xbb67ae85;
+			uint64_t p0 = uint64_t(0xd2511f53) * ctr[0];
+			uint64_t p1 = uint64_t(0xcd9e8d57) * ctr[2];
+			ctr = {{ uint32_t(p1 >> 32) ^ ctr[1] ^ k[0], uint32_t(p1),
+			         uint32_t(p0 >> 32) ^ ctr[3] ^ k[1], uint32_t(p0) }};
+		}
+		return ctr;
+	}
+
+	/**
+	 * the i-th 64-bit word of the stream identified by (seed, game, stream)
+	 */
+	static uint64_t word(uint64_t seed, uint64_t game, uint32_t stream, uint32_t i) {
+		counter c = block({{ uint32_t(game), uint32_t(game >> 32), stream, i >> 1 }}, {{ uint32_t(seed), uint32_t(seed >> 32) }});
+		return (i & 1) ? (uint64_t(c[3]) << 32 | c[2]) : (uint64_t(c[1]) << 32 | c[0]);
+	}
+};
+
+/**
+ * xoshiro256** pseudo random number generator
+ * satisfies UniformRandomBitGenerator, so it also works with std::shuffle, etc.
+ *
+ * see http://prng.di.unimi.it/ for the reference implementation
+ */
+class xoshiro {
+public:
+	typedef uint64_t result_type;
+
+	xoshiro(uint64_t seed = 0) { this->seed(seed); }
+
+	/**
+	 * expand a 64-bit seed into the 256-bit state by splitmix64
+	 */
+	void seed(uint64_t seed) {
+		for (auto& v : s) {
+			uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			v = z ^ (z >> 31);
+		}
+	}
+
+	/**
+	 * key the state by (global seed, game index, stream id) through philox
+	 * so that the streams of every game can be replayed independently
+	 */
+	void seed(uint64_t seed, uint64_t game, uint32_t stream) {
+		for (uint32_t i = 0; i < 4; i++) s[i] = philox::word(seed, game, stream, i);
+		if (!(s[0] | s[1] | s[2] | s[3])) this->seed(seed); // the all-zero state is a fixed point
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	result_type operator ()() {
+		const uint64_t result = rotl(s[1] * 5, 7) * 9;
+		const uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	/**
+	 * draw an integer from [0, n) by multiply-shift, without any rejection loop
+	 * the bias is at most n / 2^32, which is negligible for the small n used here
+	 */
+	uint32_t uniform(uint32_t n) {
+		return uint32_t(((operator()() >> 32) * n) >> 32);
+	}
+
+private:
+	static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+	uint64_t s[4];
+};
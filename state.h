@@ -98,3 +98,39 @@ private:
 	int score;
 	float esti;
 };
+
+/**
+ * compact record of the moves in an episode, for the TD update
+ *
+ * each step keeps only what the update needs, in 16 bytes:
+ *  the packed after state (see board::pack),
+ *  the reward as a 16-bit code (reward >> 3, since every merge scores a multiple of 8),
+ *  and the estimated value (reward + V(after state))
+ */
+class trajectory {
+public:
+	class step {
+	public:
+		step(const state& st) : after(st.after_state().pack()), code(st.reward() >> 3), esti(st.value()) {}
+
+		board after_state() const { return board::unpack(after); }
+		int reward() const { return int(code) << 3; }
+		float value() const { return esti; }
+
+	private:
+		uint64_t after;
+		uint16_t code;
+		float esti;
+	};
+
+public:
+	void push_back(const state& st) { path.emplace_back(st); }
+	void pop_back() { path.pop_back(); }
+	step& back() { return path.back(); }
+	size_t size() const { return path.size(); }
+	void reserve(size_t n) { path.reserve(n); }
+	void swap(trajectory& t) { path.swap(t.path); }
+
+private:
+	std::vector<step> path;
+};
@@ -7,6 +7,7 @@
 #include "action.h"
 #include "agent.h"
 #include "episode.h"
+#include "profiler.h"
 
 class statistic {
 public:
@@ -97,19 +98,45 @@ public:
 		const_cast<statistic&>(*this).block = block_temp;
 	}
 
+	size_t episodes() const {
+		return count;
+	}
+
 	bool is_finished() const {
 		return count >= total;
 	}
 
+	/**
+	 * continue counting from n finished episodes, e.g. when resuming from a checkpoint
+	 */
+	void resume(size_t n) {
+		count = n;
+		total = std::max(total, n);
+	}
+
 	void open_episode(const std::string& flag = "") {
-		if (count++ >= limit) data.pop_front();
+		if (data.size() >= limit) data.pop_front();
+		count++;
 		data.emplace_back();
 		data.back().open_episode(flag);
 	}
 
 	void close_episode(const std::string& flag = "") {
 		data.back().close_episode(flag);
-		if (count % block == 0) show();
+		if (count % block == 0) {
+			show();
+			PROFILE_REPORT(std::cout);
+		}
+	}
+
+	/**
+	 * append an episode that has been played elsewhere, e.g. in an interleaved lane
+	 */
+	void append_episode(episode&& ep, const std::string& flag = "") {
+		if (data.size() >= limit) data.pop_front();
+		count++;
+		data.push_back(std::move(ep));
+		close_episode(flag);
 	}
 
 	episode& at(size_t i) {
@@ -124,6 +151,15 @@ public:
 		return data.back();
 	}
 
+	/**
+	 * write the records of the last block, in the same format as operator <<
+	 */
+	void save_recent(std::ostream& out) const {
+		auto it = data.end();
+		for (size_t i = std::min(data.size(), block); i; i--) it--;
+		for (; it != data.end(); it++) out << *it << std::endl;
+	}
+
 	friend std::ostream& operator <<(std::ostream& out, const statistic& stat) {
 		for (const episode& rec : stat.data) out << rec << std::endl;
 		return out;
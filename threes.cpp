@@ -10,21 +10,97 @@
 #include <fstream>
 #include <iterator>
 #include <string>
+#include <memory>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
 #include "episode.h"
 #include "statistic.h"
+#include "profiler.h"
+#include "checkpoint.h"
 
 
+/**
+ * play games in 'lanes' interleaved lanes, advancing every ongoing game by one move per round
+ *
+ * the after states of all player turns are generated and their weights prefetched before any of them is evaluated,
+ * so that the cache misses of different games overlap instead of stalling one by one
+ * the games are indexed from the game= of the environment in the order they are started, as in the sequential loop,
+ * so that the run can be resumed from a checkpoint
+ * since the lanes finish their games out of order, no new game is started once a checkpoint is due,
+ * and the checkpoint is taken when all lanes are idle, i.e., when every game before the next index is finished
+ */
+void play_interleaved(statistic& stat, TD_player& play, const std::string& evil_args, size_t lanes, size_t total, checkpoint& ckpt) {
+	struct lane {
+		episode game;
+		std::unique_ptr<rndenv> evil;
+		bool ongoing = false;
+	};
+	std::vector<lane> pool(lanes);
+	for (auto& ln : pool) ln.evil.reset(new rndenv(evil_args));
+	size_t opened = stat.episodes();
+	uint64_t game = pool[0].evil->next_game(); // the index of the next game to start
+
+	while (true) {
+		bool ongoing = false;
+		bool draining = ckpt.due(stat.episodes());
+		if (draining && std::none_of(pool.begin(), pool.end(), [](const lane& ln) { return ln.ongoing; })) {
+			ckpt.wait(); // the lanes are idle anyway, a previous checkpoint still being written is not worth skipping this one
+			ckpt.take(play, stat, pool[0].evil->base_seed(), game);
+			draining = false;
+		}
+		for (size_t i = 0; i < lanes; i++) { // start new games in idle lanes
+			if (pool[i].ongoing || opened >= total || draining) continue;
+			rndenv& evil = *pool[i].evil;
+			play.select_lane(i);
+			play.open_episode("~:" + evil.name());
+			evil.set_game(game++);
+			opened++;
+			evil.open_episode(play.name() + ":~");
+			pool[i].game = episode();
+			pool[i].game.open_episode(play.name() + ":" + evil.name());
+			pool[i].ongoing = true;
+		}
+		for (size_t i = 0; i < lanes; i++) { // generate the after states of every player turn and prefetch their weights
+			if (!pool[i].ongoing || &pool[i].game.take_turns(play, *pool[i].evil) != &play) continue;
+			play.select_lane(i);
+			play.prefetch(pool[i].game.state());
+		}
+		for (size_t i = 0; i < lanes; i++) { // advance every game by one move
+			if (!pool[i].ongoing) continue;
+			ongoing = true;
+			episode& game = pool[i].game;
+			rndenv& evil = *pool[i].evil;
+			agent& who = game.take_turns(play, evil);
+			play.select_lane(i);
+			if (&who != &play || !game.state().is_terminal()) {
+				action move = who.take_action(game);
+				PROFILE_SCOPE(bookkeep);
+				if (game.apply_action(move) == true && !who.check_for_win(game.state())) continue;
+			}
+			agent& win = game.last_turns(play, evil);
+			stat.append_episode(std::move(game), win.name()); // closes the episode
+
+			play.update_episode();
+			play.close_episode(win.name());
+			evil.close_episode(win.name());
+			pool[i].ongoing = false;
+		}
+		if (!ongoing && opened >= total) break;
+	}
+}
+
 int main(int argc, const char* argv[]) {
 	std::cout << "Threes!-Demo: ";
 	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
 	std::cout << std::endl << std::endl;
 
-	size_t total = 1000, block = 0, limit = 0;
+	size_t total = 1000, block = 0, limit = 0, lanes = 1;
 	std::string play_args, evil_args;
 	std::string load, save;
+	std::string ckpt_prefix, resume;
+	size_t ckpt_games = 0;
+	double ckpt_time = 0;
 	bool summary = false;
 	for (int i = 1; i < argc; i++) {
 		std::string para(argv[i]);
@@ -42,6 +118,16 @@ int main(int argc, const char* argv[]) {
 			load = para.substr(para.find("=") + 1);
 		} else if (para.find("--save=") == 0) {
 			save = para.substr(para.find("=") + 1);
+		} else if (para.find("--lanes=") == 0) {
+			lanes = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--checkpoint=") == 0) {
+			ckpt_prefix = para.substr(para.find("=") + 1);
+		} else if (para.find("--checkpoint-games=") == 0) {
+			ckpt_games = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--checkpoint-time=") == 0) {
+			ckpt_time = std::stod(para.substr(para.find("=") + 1));
+		} else if (para.find("--resume=") == 0) {
+			resume = para.substr(para.find("=") + 1);
 		} else if (para.find("--summary") == 0) {
 			summary = true;
 		}
@@ -56,11 +142,29 @@ int main(int argc, const char* argv[]) {
 		summary |= stat.is_finished();
 	}
 
+	if (resume.size()) { // continue from a checkpoint, i.e., its weights, records, seed and game index
+		size_t episodes = 0;
+		uint64_t seed = 0, index = 0;
+		if (!checkpoint::resume(resume, episodes, seed, index)) {
+			error << "no checkpoint " << resume << std::endl;
+			return 1;
+		}
+		std::ifstream in(resume + ".stat", std::ios::in);
+		in >> stat;
+		in.close();
+		stat.resume(episodes);
+		play_args += " load=" + resume + ".weights";
+		evil_args += " seed=" + std::to_string(seed) + " game=" + std::to_string(index);
+	}
+	if (ckpt_prefix.size() && !ckpt_games && !ckpt_time) ckpt_games = 10000;
+	checkpoint ckpt(ckpt_prefix, ckpt_games, ckpt_time, stat.episodes());
+
 	//player play(play_args);
 	TD_player play(play_args);
 	rndenv evil(evil_args);
 
 	//play.init_weights(); //do I need it?
+	if (lanes > 1) play_interleaved(stat, play, evil_args, lanes, total, ckpt);
 	while (!stat.is_finished()) {
 		play.open_episode("~:" + evil.name());
 		evil.open_episode(play.name() + ":~");
@@ -69,8 +173,10 @@ int main(int argc, const char* argv[]) {
 		episode& game = stat.back();
 		while (true) {
 			agent& who = game.take_turns(play, evil);
+			if (&who == &play && game.state().is_terminal()) break; // no legal move
 			//action move = who.take_action(game.state());
 			action move = who.take_action(game);
+			PROFILE_SCOPE(bookkeep);
 			if (game.apply_action(move) != true) break;
 			if (who.check_for_win(game.state())) break;
 		}
@@ -80,7 +186,9 @@ int main(int argc, const char* argv[]) {
 		play.update_episode();
 		play.close_episode(win.name());
 		evil.close_episode(win.name());
+		if (ckpt.due(stat.episodes())) ckpt.take(play, stat, evil.base_seed(), evil.next_game());
 	}
+	ckpt.wait();
 
 	if (summary) {
 		stat.summary();
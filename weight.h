@@ -10,23 +10,49 @@
 #pragma once
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <utility>
+#include "hugepage.h"
 
 std::ostream& info = std::cout;
 std::ostream& error = std::cerr;
 //std::ostream& debug = std::cout;
 
+/**
+ * weight table, stored either dense or sparse
+ *
+ * a dense table is one array of all weights
+ * a sparse table is a page table of blocks (see below), each allocated on its first write;
+ * reading a weight of an unallocated block gives zero, so a sparse table behaves as a dense one
+ * whose untouched weights are zero, but only costs the memory of the blocks actually reached
+ */
 class weight {
 public:
+	enum storage { dense, sparse };
+
 	weight() {}
-	weight(size_t len) : value(len) {}
-	weight(weight&& f) : value(std::move(f.value)) {}
+	weight(size_t len, storage kind = dense) : length(len), kind(kind) {
+		if (kind == dense) value.resize(len);
+		else page.resize(blocks());
+		touch_all();
+	}
+	weight(weight&& f) noexcept : value(std::move(f.value)), page(std::move(f.page)), length(f.length), kind(f.kind), dirty(std::move(f.dirty)) {}
 	weight(const weight& f) = default;
 
 	weight& operator =(const weight& f) = default;
-	float& operator[] (size_t i) { return value[i]; }
-	const float& operator[] (size_t i) const { return value[i]; }
-	size_t size() const { return value.size(); }
+	float& operator[] (size_t i) {
+		if (kind == dense) return value[i];
+		std::vector<float>& blk = page[i / block];
+		if (blk.empty()) blk.resize(block);
+		return blk[i % block];
+	}
+	const float& operator[] (size_t i) const {
+		if (kind == dense) return value[i];
+		const std::vector<float>& blk = page[i / block];
+		static const float zero = 0;
+		return blk.size() ? blk[i % block] : zero;
+	}
+	size_t size() const { return length; }
 
 public: // should be implemented
 
@@ -51,24 +77,91 @@ public:
 		out << b << "eval = " << eval(b) << std::endl;
 	}
 
+	/**
+	 * both storages are saved in the same dense format, with the unallocated blocks as zeros
+	 */
 	friend std::ostream& operator <<(std::ostream& out, const weight& w) {
-		auto& value = w.value;
-		uint64_t size = value.size();
+		uint64_t size = w.size();
 		out.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
-		out.write(reinterpret_cast<const char*>(value.data()), sizeof(float) * size);
+		if (w.kind == dense) {
+			out.write(reinterpret_cast<const char*>(w.value.data()), sizeof(float) * size);
+			return out;
+		}
+		const std::vector<float> zero(block);
+		for (size_t blk = 0; blk < w.blocks(); blk++) {
+			const float* data = w.block_data(blk);
+			out.write(reinterpret_cast<const char*>(data ? data : zero.data()), sizeof(float) * w.block_size(blk));
+		}
 		return out;
 	}
 	friend std::istream& operator >>(std::istream& in, weight& w) {
-		auto& value = w.value;
 		uint64_t size = 0;
 		in.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
-		value.resize(size);
-		in.read(reinterpret_cast<char*>(value.data()), sizeof(float) * size);
+		w.length = size;
+		if (w.kind == dense) {
+			w.value.resize(size);
+			in.read(reinterpret_cast<char*>(w.value.data()), sizeof(float) * size);
+		} else {
+			w.page.assign(w.blocks(), {});
+			std::vector<float> buf(block);
+			for (size_t blk = 0; blk < w.blocks(); blk++) {
+				in.read(reinterpret_cast<char*>(buf.data()), sizeof(float) * w.block_size(blk));
+				if (std::any_of(buf.begin(), buf.end(), [](float v) { return v != 0; })) w.page[blk] = buf;
+				std::fill(buf.begin(), buf.end(), 0);
+			}
+		}
+		w.touch_all();
 		return in;
 	}
 
+public:
+	/**
+	 * the number of allocated blocks, i.e., the occupancy of a sparse table
+	 */
+	size_t allocated() const {
+		if (kind == dense) return blocks();
+		return std::count_if(page.begin(), page.end(), [](const std::vector<float>& blk) { return blk.size(); });
+	}
+	storage type() const { return kind; }
+
+	/**
+	 * the header of a weight file, which marks the base-15 indexing of iso_pattern (see iso_pattern::indexof)
+	 * the files saved before it have no header, and their weights were indexed by 4-bit fields, so they cannot be loaded
+	 */
+	static const std::string& signature() {
+		static const std::string sig("tuple15w");
+		return sig;
+	}
+
+public:
+	/**
+	 * dirty block tracking for incremental checkpoints
+	 * the table is divided into blocks of 1024 weights (4KB), and a bit is set for each block changed since
+	 * the last clean(); a new or loaded table is entirely dirty
+	 */
+	static constexpr size_t block = 1024;
+
+	size_t blocks() const { return (length + block - 1) / block; }
+	size_t block_size(size_t blk) const { return std::min(block, length - blk * block); }
+	/**
+	 * the weights of a block, or nullptr if it is an unallocated block of a sparse table (all zeros)
+	 */
+	const float* block_data(size_t blk) const {
+		if (kind == dense) return value.data() + blk * block;
+		return page[blk].size() ? page[blk].data() : nullptr;
+	}
+
+	void touch(size_t i) { dirty[i >> 16] |= 1ull << ((i >> 10) & 63); }
+	void touch_all() { dirty.assign((blocks() + 63) / 64, -1ull); }
+	bool is_dirty(size_t blk) const { return (dirty[blk >> 6] >> (blk & 63)) & 1; }
+	void clean(size_t blk) { dirty[blk >> 6] &= ~(1ull << (blk & 63)); }
+
 protected:
-	std::vector<float> value;//15^4 wieght table
+	std::vector<float, table_allocator<float>> value;//15^4 wieght table
+	std::vector<std::vector<float>> page; // the blocks of a sparse table, empty if not yet allocated
+	size_t length = 0;
+	storage kind = dense;
+	std::vector<uint64_t> dirty;
 };
 
 /**
@@ -81,13 +174,17 @@ protected:
  *  8  9 10 11
  * 12 13 14 15
  *
+ * the table has 15^k weights for a k-tuple, e.g., 11.4M for a 6-tuple and 2.6G for an 8-tuple,
+ * so tuples larger than 6 should use the sparse storage
+ *
  * usage:
  *  pattern({ 0, 1, 2, 3 })
  *  pattern({ 0, 1, 2, 3, 4, 5 })
+ *  pattern({ 0, 1, 2, 3, 4, 5, 6, 7 }, 8, weight::sparse)
  */
 class iso_pattern : public weight {
 public:
-	iso_pattern(const std::vector<int>& p, int iso = 8) : weight(/*1 << (p.size() * 4)*/15*15*15*15*15*15), iso_last(iso) {
+	iso_pattern(const std::vector<int>& p, int iso = 8, storage kind = dense) : weight(radix(p.size()), kind), iso_last(iso) {
 		if (p.empty()) {
 			error << "no pattern defined" << std::endl;
 			std::exit(1);
@@ -111,6 +208,7 @@ public:
 	}
 	iso_pattern(){}
 	iso_pattern(const iso_pattern& p) = default;
+	iso_pattern(iso_pattern&& p) = default;
 	//pattern(const pattern& p) = delete;
 	virtual ~iso_pattern() {}
 	iso_pattern& operator =(const iso_pattern& p) = delete;
@@ -139,10 +237,40 @@ public:
 			size_t index = indexof(pattern[i], b);
 			operator[](index) += u_split;
 			value += operator[](index);
+			touch(index);
+		}
+		return value;
+	}
+
+	/**
+	 * the indices of a given board, one for each isomorphism, so that they can be prefetched and evaluated later
+	 */
+	void indices(const board& b, size_t* index) const {
+		for (int i = 0; i < iso_last; i++) {
+			index[i] = indexof(pattern[i], b);
+		}
+	}
+
+	/**
+	 * estimate the value of a board by its indices, the same as eval() of the board
+	 */
+	float eval(const size_t* index) const {
+		float value = 0;
+		for (int i = 0; i < iso_last; i++) {
+			value += operator[](index[i]);
 		}
 		return value;
 	}
 
+	/**
+	 * prefetch the weights of a board by its indices, so that a later eval() or update() will hit the cache
+	 */
+	void prefetch(const size_t* index) const {
+		for (int i = 0; i < iso_last; i++) {
+			__builtin_prefetch(&operator[](index[i]));
+		}
+	}
+
 	/**
 	 * get the name of this feature
 	 */
@@ -168,8 +296,8 @@ public:
 		for (int i = 0; i < iso_last; i++) {
 			out << "#" << i << ":" << nameof(pattern[i]) << "(";
 			size_t index = indexof(pattern[i], b);
-			for (size_t i = 0; i < pattern[i].size(); i++) {
-				out << std::hex << ((index >> (4 * i)) & 0x0f);
+			for (int t : pattern[i]) {
+				out << std::hex << b(t);
 			}
 			out << std::dec << ") = " << operator[](index) << std::endl;
 		}
@@ -178,10 +306,19 @@ public:
 
 protected:
 
+	/**
+	 * the index of a pattern in base 15, since a tile is at most 14 (6144), so that a 6-tuple fits in 15^6 weights
+	 */
+	static size_t radix(size_t k) {
+		size_t n = 1;
+		while (k--) n *= 15;
+		return n;
+	}
+
 	size_t indexof(const std::vector<int>& patt, const board& b) const {
 		size_t index = 0;
-		for (size_t i = 0; i < patt.size(); i++)
-			index |= b(patt[i]) << (4*i);
+		for (size_t i = patt.size(); i--; )
+			index = index * 15 + std::min(b(patt[i]), 14u);
 		return index;
 	}
 